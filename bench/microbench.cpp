@@ -0,0 +1,636 @@
+#include "analysis.h"
+#include "driver.h"
+#include "options.h"
+#include "store.h"
+#include "summary.h"
+
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/Regex.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace mh;
+using namespace std;
+using namespace llvm;
+
+namespace
+{
+    enum class OutputFormat
+    {
+        Text,
+        Json,
+    };
+
+    cl::OptionCategory bench_category{"Microbenchmark Options"};
+
+    cl::opt<string> filter{"filter", cl::desc("Only run benchmarks whose name matches the regex"),
+                           cl::value_desc("regex"), cl::init(".*"), cl::cat(bench_category)};
+
+    cl::opt<double> min_sample_time{
+        "min-sample-time", cl::desc("Seconds a sample runs at least, iterations are calibrated"),
+        cl::init(0.05), cl::cat(bench_category)};
+
+    cl::opt<int> num_samples{"samples", cl::desc("Number of timed samples of each benchmark"),
+                             cl::init(15), cl::cat(bench_category)};
+
+    cl::opt<string> captured_input{
+        "input", cl::desc("Module to analyze first, its largest summaries are benchmarked too"),
+        cl::value_desc("filename"), cl::init(""), cl::cat(bench_category)};
+
+    cl::opt<int> num_captured{"captured-stores",
+                              cl::desc("Number of largest summaries of -input to benchmark"),
+                              cl::init(3), cl::cat(bench_category)};
+
+    cl::opt<unsigned> seed{"seed", cl::desc("Seed of the synthetic inputs"), cl::init(42),
+                           cl::cat(bench_category)};
+
+    cl::opt<string> output_file{"o", cl::desc("Result file (default = stdout)"),
+                                cl::value_desc("filename"), cl::init("-"), cl::cat(bench_category)};
+
+    cl::opt<OutputFormat> output_format{
+        "format", cl::desc("Result format"),
+        cl::values(clEnumValN(OutputFormat::Text, "text", "human readable lines (default)"),
+                   clEnumValN(OutputFormat::Json, "json", "one JSON document of all benchmarks")),
+        cl::init(OutputFormat::Text), cl::cat(bench_category)};
+
+    constexpr int kNumInputs    = 8;
+    constexpr int kNumObjects   = 64;
+    constexpr int kNumCallSites = 16;
+
+    // keeps results of benchmarked operations alive
+    volatile size_t benchmark_sink = 0;
+
+    struct Benchmark
+    {
+        string name;
+
+        // run the operation the given number of times
+        function<void(int64_t)> run;
+    };
+
+    struct BenchmarkResult
+    {
+        string name;
+        int64_t iterations = 0;
+
+        // nanoseconds per operation
+        double median_ns = 0;
+        double min_ns    = 0;
+
+        // median absolute deviation relative to the median
+        double mad_ratio = 0;
+    };
+
+    double MeasureSeconds(const Benchmark& bench, int64_t iterations)
+    {
+        auto t_start = chrono::steady_clock::now();
+        bench.run(iterations);
+        return chrono::duration<double>(chrono::steady_clock::now() - t_start).count();
+    }
+
+    // run a warmup, calibrate iterations per sample to at least `min_sample_time`, and take the
+    // median of the samples, so that a single preempted sample doesn't skew the result
+    BenchmarkResult RunBenchmark(const Benchmark& bench)
+    {
+        int64_t iterations = 1;
+        while (MeasureSeconds(bench, iterations) < min_sample_time && iterations < (1 << 30))
+        {
+            iterations *= 2;
+        }
+
+        vector<double> samples;
+        for (int i = 0; i < max(1, num_samples.getValue()); ++i)
+        {
+            samples.push_back(MeasureSeconds(bench, iterations) * 1e9 / iterations);
+        }
+
+        auto median = [](vector<double> values) {
+            std::sort(values.begin(), values.end());
+            size_t n = values.size();
+            return n % 2 == 1 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+        };
+
+        BenchmarkResult result;
+        result.name       = bench.name;
+        result.iterations = iterations;
+        result.median_ns  = median(samples);
+        result.min_ns     = *min_element(samples.begin(), samples.end());
+
+        vector<double> deviations;
+        for (double sample : samples)
+        {
+            deviations.push_back(abs(sample - result.median_ns));
+        }
+        result.mad_ratio = result.median_ns > 0 ? median(deviations) / result.median_ns : 0;
+
+        return result;
+    }
+
+    // Synthetic function providing definitions of locations
+    //
+    //   void @bench(i8** %p0, ..., i8** %p7)
+    //     %obj0 = alloca i8, ..., %obj63 = alloca i8
+    //     call void @callee(), ... x 16
+    //     %ld = load i8*, i8** %p0
+    //     ret void
+    struct SyntheticModule
+    {
+        LLVMContext llvm_ctx;
+        unique_ptr<Module> module = make_unique<Module>("microbench", llvm_ctx);
+
+        Function* func = nullptr;
+        vector<const Instruction*> objects;
+        vector<const Instruction*> call_sites;
+        const Instruction* load = nullptr;
+
+        SyntheticModule()
+        {
+            Type* void_ty = Type::getVoidTy(llvm_ctx);
+            Type* ptr_ty  = Type::getInt8PtrTy(llvm_ctx)->getPointerTo();
+
+            FunctionType* func_ty =
+                FunctionType::get(void_ty, vector<Type*>(kNumInputs, ptr_ty), false);
+            func = Function::Create(func_ty, Function::ExternalLinkage, "bench", *module);
+
+            FunctionCallee callee =
+                module->getOrInsertFunction("callee", FunctionType::get(void_ty, false));
+
+            IRBuilder<> builder{BasicBlock::Create(llvm_ctx, "entry", func)};
+            for (int i = 0; i < kNumObjects; ++i)
+            {
+                objects.push_back(builder.CreateAlloca(builder.getInt8Ty(), nullptr,
+                                                       fmt::format("obj{}", i)));
+            }
+            for (int i = 0; i < kNumCallSites; ++i)
+            {
+                call_sites.push_back(builder.CreateCall(callee));
+            }
+            load = builder.CreateLoad(builder.getInt8PtrTy(), func->getArg(0), "ld");
+            builder.CreateRetVoid();
+        }
+    };
+
+    // random constraints and stores over the locations of SyntheticModule
+    class SyntheticStoreGenerator
+    {
+    private:
+        mt19937 rng_;
+        vector<AbstractLocation> locs_;
+
+    public:
+        SyntheticStoreGenerator(const SyntheticModule& module, unsigned seed) : rng_(seed)
+        {
+            SmtProvider::Current().ReserveAliasVariables(kNumInputs);
+
+            for (const Argument& arg : module.func->args())
+            {
+                locs_.push_back(AbstractLocation::FromRuntimeMemory(&arg, 1));
+                locs_.push_back(AbstractLocation::FromRuntimeMemory(&arg, 2));
+            }
+
+            // objects relabeled with call points, as instantiated summaries are
+            for (const Instruction* obj : module.objects)
+            {
+                for (int call_point = 0; call_point < 8; ++call_point)
+                {
+                    locs_.push_back(AbstractLocation::FromAllocation(obj).Relabel(call_point));
+                }
+            }
+        }
+
+        AbstractLocation RandomLocation() { return locs_[Uniform(locs_.size())]; }
+
+        // alias predicates over inputs combined up to `depth` levels, a quarter of them weakened
+        Constraint RandomConstraint(int depth)
+        {
+            if (depth == 0 || Uniform(4) == 0)
+            {
+                int i = Uniform(kNumInputs);
+                int j = Uniform(kNumInputs);
+                z3::expr alias = SmtProvider::Current().CreateAliasExpr(i, j);
+                return Uniform(2) == 0 ? Constraint{alias} : Constraint{!alias};
+            }
+
+            Constraint lhs = RandomConstraint(depth - 1);
+            Constraint rhs = RandomConstraint(depth - 1);
+            Constraint c   = Uniform(2) == 0 ? (lhs && rhs) : (lhs || rhs);
+            return Uniform(4) == 0 ? c.Weaken() : c;
+        }
+
+        PointToMap RandomPointToMap(int num_edges)
+        {
+            PointToMap pt_map;
+            for (int i = 0; i < num_edges; ++i)
+            {
+                AddPointToEdge(pt_map, RandomLocation(), RandomConstraint(2));
+            }
+
+            return pt_map;
+        }
+
+        AbstractStore RandomStore(int num_locs, int num_edges)
+        {
+            AbstractStore store;
+            while (store.size() < min<size_t>(num_locs, locs_.size()))
+            {
+                store[RandomLocation()] = RandomPointToMap(num_edges);
+            }
+
+            return store;
+        }
+
+    private:
+        int Uniform(int n) { return uniform_int_distribution<int>{0, n - 1}(rng_); }
+    };
+
+    // a variant of a store as seen from another predecessor at a join, half of the locations
+    // are unchanged, others lose or weaken some of their edges, or are missing
+    AbstractStore PerturbStore(const AbstractStore& store, unsigned seed)
+    {
+        mt19937 rng{seed};
+        auto uniform = [&](int n) { return uniform_int_distribution<int>{0, n - 1}(rng); };
+
+        AbstractStore result;
+        for (const auto& [loc, pt_map] : store)
+        {
+            int choice = uniform(4);
+            if (choice < 2)
+            {
+                result.insert(pair{loc, pt_map});
+            }
+            else if (choice == 2)
+            {
+                PointToMap& pt_map_result = result[loc];
+                for (const auto& [target, c] : pt_map)
+                {
+                    if (uniform(3) != 0)
+                    {
+                        pt_map_result.insert(pair{target, uniform(2) == 0 ? c : c.Weaken()});
+                    }
+                }
+            }
+        }
+
+        return result;
+    }
+
+    void AddConstraintBenchmarks(vector<Benchmark>& benchmarks, SyntheticStoreGenerator& gen)
+    {
+        auto lhs = make_shared<vector<Constraint>>();
+        auto rhs = make_shared<vector<Constraint>>();
+        for (int i = 0; i < 256; ++i)
+        {
+            lhs->push_back(gen.RandomConstraint(3));
+            rhs->push_back(gen.RandomConstraint(3));
+        }
+
+        auto add = [&](string name, function<Constraint(const Constraint&, const Constraint&)> op) {
+            benchmarks.push_back({"Constraint/" + name, [=](int64_t iterations) {
+                                      for (int64_t i = 0; i < iterations; ++i)
+                                      {
+                                          Constraint c = op((*lhs)[i % 256], (*rhs)[i % 256]);
+                                          benchmark_sink += c.HasSameMayMust();
+                                      }
+                                  }});
+        };
+
+        add("And", [](const Constraint& c1, const Constraint& c2) { return c1 && c2; });
+        add("Or", [](const Constraint& c1, const Constraint& c2) { return c1 || c2; });
+        add("Weaken", [](const Constraint& c1, const Constraint&) { return c1.Weaken(); });
+        add("Combine", [](const Constraint& c1, const Constraint& c2) { return c1.Combine(c2); });
+    }
+
+    // operations over a store and a different store of the same function
+    // NOTE copies of the store are part of the timing of mutating operations, see CopyAbstractStore
+    void AddStoreOperationBenchmarks(vector<Benchmark>& benchmarks, const string& label,
+                                     shared_ptr<AbstractStore> store,
+                                     shared_ptr<AbstractStore> other,
+                                     shared_ptr<ConstraintSolver> solver)
+    {
+        benchmarks.push_back({"CopyAbstractStore/" + label, [=](int64_t iterations) {
+                                  for (int64_t i = 0; i < iterations; ++i)
+                                  {
+                                      AbstractStore copy = *store;
+                                      benchmark_sink += copy.size();
+                                  }
+                              }});
+
+        benchmarks.push_back({"MergeAbstractStore/" + label, [=](int64_t iterations) {
+                                  for (int64_t i = 0; i < iterations; ++i)
+                                  {
+                                      AbstractStore merged = *store;
+                                      MergeAbstractStore(merged, *other);
+                                      benchmark_sink += merged.size();
+                                  }
+                              }});
+
+        benchmarks.push_back({"EqualAbstractStore/" + label + "/equal", [=](int64_t iterations) {
+                                  for (int64_t i = 0; i < iterations; ++i)
+                                  {
+                                      benchmark_sink += EqualAbstractStore(*solver, *store, *store);
+                                  }
+                              }});
+
+        benchmarks.push_back({"EqualAbstractStore/" + label + "/differ", [=](int64_t iterations) {
+                                  for (int64_t i = 0; i < iterations; ++i)
+                                  {
+                                      benchmark_sink += EqualAbstractStore(*solver, *other, *store);
+                                  }
+                              }});
+
+        benchmarks.push_back({"NormalizeStore/" + label, [=](int64_t iterations) {
+                                  for (int64_t i = 0; i < iterations; ++i)
+                                  {
+                                      AbstractStore normalized = *store;
+                                      NormalizeStore(*solver, normalized);
+                                      benchmark_sink += normalized.size();
+                                  }
+                              }});
+    }
+
+    // stores of `num_locs` locations with `num_edges` edges each
+    void AddStoreBenchmarks(vector<Benchmark>& benchmarks, SyntheticStoreGenerator& gen,
+                            const string& label, int num_locs, int num_edges)
+    {
+        auto store     = make_shared<AbstractStore>(gen.RandomStore(num_locs, num_edges));
+        auto perturbed = make_shared<AbstractStore>(PerturbStore(*store, seed));
+        auto solver    = make_shared<ConstraintSolver>(kNumInputs);
+
+        auto edges = make_shared<vector<pair<AbstractLocation, Constraint>>>();
+        for (int i = 0; i < num_locs * num_edges; ++i)
+        {
+            edges->push_back({gen.RandomLocation(), gen.RandomConstraint(2)});
+        }
+
+        benchmarks.push_back({"AddPointToEdge/" + label, [=](int64_t iterations) {
+                                  PointToMap pt_map;
+                                  for (int64_t i = 0; i < iterations; ++i)
+                                  {
+                                      if (i % edges->size() == 0)
+                                      {
+                                          pt_map.clear();
+                                      }
+
+                                      const auto& [loc, c] = (*edges)[i % edges->size()];
+                                      AddPointToEdge(pt_map, loc, c);
+                                  }
+                                  benchmark_sink += pt_map.size();
+                              }});
+
+        AddStoreOperationBenchmarks(benchmarks, label, store, perturbed, solver);
+    }
+
+    void AddCallPointBenchmarks(vector<Benchmark>& benchmarks, const SyntheticModule& module)
+    {
+        // chains of distinct call sites, from each call site
+        auto chains = make_shared<vector<const Instruction*>>();
+        for (int first = 0; first < kNumCallSites; ++first)
+        {
+            for (int depth = 0; depth < 8; ++depth)
+            {
+                chains->push_back(module.call_sites[(first + depth * 5) % kNumCallSites]);
+            }
+        }
+
+        // allocation of call points in a fresh environment
+        benchmarks.push_back({"ComputeCallPoint/allocate", [=](int64_t iterations) {
+                                  auto env       = make_unique<SummaryEnvironment>();
+                                  int call_point = 0;
+                                  for (int64_t i = 0; i < iterations; ++i)
+                                  {
+                                      if (i % chains->size() == 0)
+                                      {
+                                          env = make_unique<SummaryEnvironment>();
+                                      }
+
+                                      const Instruction* inst = (*chains)[i % chains->size()];
+                                      int prev   = i % 8 == 0 ? 0 : call_point;
+                                      call_point = env->ComputeCallPoint(inst, prev);
+                                  }
+                                  benchmark_sink += call_point;
+                              }});
+
+        // lookup of call points already allocated, as in repeated instantiations
+        auto env         = make_shared<SummaryEnvironment>();
+        auto prev_points = make_shared<vector<int>>();
+        for (size_t i = 0; i < chains->size(); ++i)
+        {
+            prev_points->push_back(i % 8 == 0 ? 0 : env->ComputeCallPoint((*chains)[i - 1],
+                                                                          prev_points->back()));
+        }
+
+        benchmarks.push_back({"ComputeCallPoint/lookup", [=](int64_t iterations) {
+                                  for (int64_t i = 0; i < iterations; ++i)
+                                  {
+                                      size_t k = i % chains->size();
+                                      benchmark_sink +=
+                                          env->ComputeCallPoint((*chains)[k], (*prev_points)[k]);
+                                  }
+                              }});
+    }
+
+    // transfer functions of loads and stores through pointers with `num_targets` targets
+    void AddExecutionBenchmarks(vector<Benchmark>& benchmarks, SyntheticModule& module,
+                                SyntheticStoreGenerator& gen, int num_targets)
+    {
+        // the context is deleted before the environment holding its summary
+        auto env                 = make_shared<SummaryEnvironment>();
+        FunctionSummary& summary = env->LookupSummary(module.func);
+        shared_ptr<AnalysisContext> ctx{new AnalysisContext{env.get(), &summary},
+                                        [env](AnalysisContext* ctx) { delete ctx; }};
+
+        const Argument* ptr = module.func->getArg(0);
+        const Argument* val = module.func->getArg(1);
+
+        // the pointer may point to each target, each target to a few values
+        PointToMap pt_map_ptr;
+        auto store = make_shared<AbstractStore>();
+        while (pt_map_ptr.size() < num_targets)
+        {
+            AbstractLocation target = gen.RandomLocation();
+            AddPointToEdge(pt_map_ptr, target, gen.RandomConstraint(2));
+            (*store)[target] = gen.RandomPointToMap(4);
+        }
+
+        ctx->UpdateRegFile(ptr, pt_map_ptr);
+        ctx->UpdateRegFile(val, gen.RandomPointToMap(4));
+
+        string label = fmt::format("{}-targets", num_targets);
+
+        const Instruction* load = module.load;
+        benchmarks.push_back({"DoLoad/" + label, [=](int64_t iterations) {
+                                  for (int64_t i = 0; i < iterations; ++i)
+                                  {
+                                      AbstractExecution exec{ctx.get(), store.get()};
+                                      exec.DoLoad(load, ptr);
+                                  }
+                                  benchmark_sink += ctx->LookupRegFile(load).size();
+                              }});
+
+        // NOTE a weak update conjoins the negated pointer constraint to old edges, so every
+        // iteration stores into a fresh copy of the targets
+        benchmarks.push_back({"DoStore/" + label, [=](int64_t iterations) {
+                                  for (int64_t i = 0; i < iterations; ++i)
+                                  {
+                                      AbstractExecution exec{ctx.get(), *store};
+                                      exec.DoStore(val, ptr);
+                                  }
+                              }});
+    }
+
+    // summaries of a real module, the largest stores first
+    vector<const FunctionSummary*> CaptureSummaries(SummaryEnvironment& env, Module& module)
+    {
+        CallGraph call_graph{module};
+        for (auto it = scc_begin(&call_graph); !it.isAtEnd(); ++it)
+        {
+            AnalyzeCallGraphSCC(env, nullptr, *it);
+        }
+
+        vector<const FunctionSummary*> summaries;
+        for (const Function& func : module)
+        {
+            if (!func.isDeclaration())
+            {
+                summaries.push_back(&env.LookupSummary(&func));
+            }
+        }
+
+        std::sort(summaries.begin(), summaries.end(), [](const auto* lhs, const auto* rhs) {
+            return lhs->store.size() > rhs->store.size();
+        });
+        summaries.resize(min<size_t>(summaries.size(), max(0, num_captured.getValue())));
+
+        return summaries;
+    }
+
+    void PrintTextResults(raw_ostream& os, const vector<BenchmarkResult>& results)
+    {
+        os << fmt::format("{:<56} {:>14} {:>14} {:>8} {:>12}\n", "benchmark", "median ns/op",
+                          "min ns/op", "mad", "iterations");
+        for (const BenchmarkResult& result : results)
+        {
+            os << fmt::format("{:<56} {:>14.1f} {:>14.1f} {:>7.1f}% {:>12}\n", result.name,
+                              result.median_ns, result.min_ns, result.mad_ratio * 100,
+                              result.iterations);
+        }
+    }
+
+    void PrintJsonResults(raw_ostream& os, const vector<BenchmarkResult>& results)
+    {
+        json::OStream json{os, 2};
+        json.array([&] {
+            for (const BenchmarkResult& result : results)
+            {
+                json.object([&] {
+                    json.attribute("name", result.name);
+                    json.attribute("iterations", result.iterations);
+                    json.attribute("median_ns", result.median_ns);
+                    json.attribute("min_ns", result.min_ns);
+                    json.attribute("mad_ratio", result.mad_ratio);
+                });
+            }
+        });
+        os << "\n";
+    }
+} // namespace
+
+// Microbenchmarks of the primitives of the analysis domain, on synthetic inputs and optionally on
+// summaries of a real module, see -input
+int main(int argc, char** argv)
+{
+    InitLLVM init{argc, argv};
+    cl::ParseCommandLineOptions(argc, argv, "heap analysis microbenchmarks\n");
+
+    Regex filter_regex{filter};
+    string error;
+    if (!filter_regex.isValid(error))
+    {
+        errs() << fmt::format("error: invalid filter '{}': {}\n", filter, error);
+        return 1;
+    }
+
+    error_code ec;
+    ToolOutputFile output{output_file, ec, sys::fs::OF_Text};
+    if (ec)
+    {
+        errs() << fmt::format("error: can't open {}: {}\n", output_file, ec.message());
+        return 1;
+    }
+
+    // captured summaries are analyzed on this thread, so that their constraints can be used here
+    AnalysisOptions::Current().num_threads = 1;
+
+    SyntheticModule module;
+    SyntheticStoreGenerator gen{module, seed};
+
+    vector<Benchmark> benchmarks;
+    AddConstraintBenchmarks(benchmarks, gen);
+    AddStoreBenchmarks(benchmarks, gen, "32x2", 32, 2);
+    AddStoreBenchmarks(benchmarks, gen, "512x4", 512, 4);
+    AddCallPointBenchmarks(benchmarks, module);
+    AddExecutionBenchmarks(benchmarks, module, gen, 1);
+    AddExecutionBenchmarks(benchmarks, module, gen, 16);
+
+    LLVMContext captured_ctx;
+    unique_ptr<Module> captured_module;
+    SummaryEnvironment captured_env;
+    if (!captured_input.empty())
+    {
+        SMDiagnostic diag;
+        captured_module = parseIRFile(captured_input, diag, captured_ctx);
+        if (captured_module == nullptr)
+        {
+            diag.print(argv[0], errs());
+            return 1;
+        }
+
+        for (const FunctionSummary* summary : CaptureSummaries(captured_env, *captured_module))
+        {
+            auto store = make_shared<AbstractStore>(summary->store);
+            auto other = make_shared<AbstractStore>(PerturbStore(*store, seed));
+
+            AddStoreOperationBenchmarks(
+                benchmarks, fmt::format("captured/{}", summary->func->getName().str()), store,
+                other, make_shared<ConstraintSolver>(summary->inputs.size()));
+        }
+    }
+
+    vector<BenchmarkResult> results;
+    for (const Benchmark& bench : benchmarks)
+    {
+        if (filter_regex.match(bench.name))
+        {
+            results.push_back(RunBenchmark(bench));
+        }
+    }
+
+    if (output_format == OutputFormat::Json)
+    {
+        PrintJsonResults(output.os(), results);
+    }
+    else
+    {
+        PrintTextResults(output.os(), results);
+    }
+
+    output.keep();
+    return 0;
+}
@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+"""Corpus benchmark of the heap analysis.
+
+Runs the standalone driver on every bitcode file under test/app and writes one JSON document with
+wall time, peak RSS, solver queries, RAW counts and per-function cost of each module. Given a
+baseline from a previous run, flags modules that got slower, query more or report different RAW
+counts, and exits with 1 if any regression is found.
+
+    bench/run_bench.py --tool build/heap-analysis -o results.json
+    bench/run_bench.py --tool build/heap-analysis --baseline baseline.json
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+REPO_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+FORMAT_VERSION = 1
+
+
+def discover_inputs(corpus_dir):
+    inputs = []
+    for root, _, files in os.walk(corpus_dir):
+        for name in files:
+            if name.endswith(".bc"):
+                inputs.append(os.path.join(root, name))
+
+    return sorted(inputs)
+
+
+def run_module(args, path):
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        report_path = os.path.join(tmp_dir, "report.json")
+        command = [args.tool, "-format=json", "-o", report_path, "-j", str(args.jobs), path]
+        command += args.tool_args
+
+        t_start = time.monotonic()
+        try:
+            proc = subprocess.run(command, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL,
+                                  timeout=args.timeout)
+            status = {0: "complete", 2: "incomplete"}.get(proc.returncode, "error")
+        except subprocess.TimeoutExpired:
+            status = "timeout"
+        wall_time = time.monotonic() - t_start
+
+        result = {"status": status, "wall_time_s": round(wall_time, 3)}
+        if status in ("complete", "incomplete"):
+            with open(report_path) as f:
+                report = json.load(f)[0]
+
+            result["peak_rss_kb"] = report["peak_rss_kb"]
+            result["solver_queries"] = report["solver_queries"]
+            result["raw"] = report["raw"]
+            result["functions"] = {
+                func["name"]: {
+                    "time_ms": round(func["time_ms"], 3),
+                    "solver_queries": func["solver_queries"],
+                }
+                for func in report["functions"]
+            }
+
+        return result
+
+
+def exceeds(current, baseline, threshold, min_delta):
+    return current - baseline > max(baseline * threshold, min_delta)
+
+
+def compare(results, baseline, args):
+    regressions = []
+    for name, base in sorted(baseline["modules"].items()):
+        cur = results["modules"].get(name)
+        if cur is None:
+            continue
+
+        if cur["status"] != base["status"]:
+            regressions.append(f"{name}: status {base['status']} -> {cur['status']}")
+            continue
+
+        if exceeds(cur["wall_time_s"], base["wall_time_s"], args.time_threshold,
+                   args.min_time_delta):
+            regressions.append(
+                f"{name}: wall time {base['wall_time_s']:.2f}s -> {cur['wall_time_s']:.2f}s")
+
+        if "raw" not in base:
+            continue
+
+        if exceeds(cur["solver_queries"], base["solver_queries"], args.query_threshold, 0):
+            regressions.append(
+                f"{name}: solver queries {base['solver_queries']} -> {cur['solver_queries']}")
+
+        if exceeds(cur["peak_rss_kb"], base["peak_rss_kb"], args.memory_threshold, 0):
+            regressions.append(
+                f"{name}: peak RSS {base['peak_rss_kb']} KB -> {cur['peak_rss_kb']} KB")
+
+        # RAW counts are the result of the analysis, any difference is a change in precision
+        if cur["raw"] != base["raw"]:
+            regressions.append(f"{name}: RAW counts {base['raw']} -> {cur['raw']}")
+
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmark the heap analysis over a corpus")
+    parser.add_argument("--tool", required=True, help="path of the heap-analysis executable")
+    parser.add_argument("--corpus", default=os.path.join(REPO_DIR, "test", "app"),
+                        help="directory searched for .bc files (default: test/app)")
+    parser.add_argument("--filter", default="",
+                        help="only run inputs whose path contains the string")
+    parser.add_argument("-o", "--output", help="results file (default: stdout)")
+    parser.add_argument("-j", "--jobs", type=int, default=1, help="analysis threads per module")
+    parser.add_argument("--timeout", type=float, default=1800, help="seconds per module")
+    parser.add_argument("--baseline", help="results of a previous run to compare against")
+    parser.add_argument("--time-threshold", type=float, default=0.10,
+                        help="relative wall time increase reported as regression")
+    parser.add_argument("--min-time-delta", type=float, default=0.5,
+                        help="seconds of wall time increase below which noise is assumed")
+    parser.add_argument("--query-threshold", type=float, default=0.05,
+                        help="relative increase of solver queries reported as regression")
+    parser.add_argument("--memory-threshold", type=float, default=0.20,
+                        help="relative increase of peak RSS reported as regression")
+    parser.add_argument("tool_args", nargs="*",
+                        help="extra options of the tool, after --, e.g. -heap-analysis-sparse-store")
+    args = parser.parse_args()
+
+    inputs = [path for path in discover_inputs(args.corpus) if args.filter in path]
+    if not inputs:
+        print(f"error: no input found in {args.corpus}", file=sys.stderr)
+        return 1
+
+    results = {
+        "version": FORMAT_VERSION,
+        "options": {"jobs": args.jobs, "tool_args": args.tool_args},
+        "modules": {},
+    }
+    for path in inputs:
+        name = os.path.relpath(path, args.corpus)
+        print(f"running {name} ...", file=sys.stderr, flush=True)
+
+        result = run_module(args, path)
+        results["modules"][name] = result
+
+        print(f"  {result['status']}, {result['wall_time_s']:.2f}s", file=sys.stderr, flush=True)
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(results, f, indent=2)
+            f.write("\n")
+    else:
+        json.dump(results, sys.stdout, indent=2)
+        sys.stdout.write("\n")
+
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+
+        if baseline.get("options") != results["options"]:
+            print("warning: baseline was run with different options", file=sys.stderr)
+
+        regressions = compare(results, baseline, args)
+        for regression in regressions:
+            print(f"REGRESSION {regression}", file=sys.stderr)
+
+        if regressions:
+            return 1
+
+        print("no regression against the baseline", file=sys.stderr)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
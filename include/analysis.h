@@ -4,11 +4,18 @@
 #include "location.h"
 #include "summary.h"
 #include "controlflow.h"
+#include "memory.h"
+#include "memoryssa.h"
 #include "utils.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/InstVisitor.h"
+#include <functional>
+#include <optional>
+#include <unordered_map>
 #include <vector>
+#include <map>
+#include <utility>
 #include <set>
 
 namespace mh
@@ -17,7 +24,99 @@ namespace mh
     // tag register, i.e. llvm::Value*
     // Such practice reduce memory consumption and redundent computation during analysis because of
     // SSA form
-    using AbstractRegFile = std::unordered_map<const llvm::Value*, PointToMap>;
+    //
+    // Registers numbered in the function are kept in a flat vector, only globals and constants are
+    // looked up in a hash map
+    class AbstractRegFile
+    {
+    private:
+        // NOTE must outlive this object
+        const FunctionNumbering* numbering_;
+
+        std::vector<PointToMap> local_regs_;
+        std::unordered_map<const llvm::Value*, PointToMap> other_regs_;
+
+    public:
+        AbstractRegFile(const FunctionNumbering& numbering)
+            : numbering_(&numbering), local_regs_(numbering.NumValues())
+        {
+        }
+
+        PointToMap& operator[](const llvm::Value* reg)
+        {
+            int number = numbering_->ValueNumber(reg);
+            return number != FunctionNumbering::kNoNumber ? local_regs_[number] : other_regs_[reg];
+        }
+
+        /**
+         * Lookup the point-to map of a register, empty if it's never assigned
+         */
+        const PointToMap& Lookup(const llvm::Value* reg) const
+        {
+            static const PointToMap empty;
+
+            if (int number = numbering_->ValueNumber(reg); number != FunctionNumbering::kNoNumber)
+            {
+                return local_regs_[number];
+            }
+
+            auto it = other_regs_.find(reg);
+            return it != other_regs_.end() ? it->second : empty;
+        }
+
+        /**
+         * Call `f(reg, pt_map)` for each register with a non-empty point-to map
+         */
+        template <typename F>
+        void ForEach(F f)
+        {
+            for (int i = 0; i < static_cast<int>(local_regs_.size()); ++i)
+            {
+                if (!local_regs_[i].empty())
+                {
+                    f(numbering_->Value(i), local_regs_[i]);
+                }
+            }
+
+            for (auto& [reg, pt_map] : other_regs_)
+            {
+                if (!pt_map.empty())
+                {
+                    f(reg, pt_map);
+                }
+            }
+        }
+
+        friend size_t EstimateMemoryUsage(const AbstractRegFile& regfile) noexcept;
+    };
+
+    size_t EstimateMemoryUsage(const AbstractRegFile& regfile) noexcept;
+
+    // Facts of a function that don't change across analyses of the function, computed once and
+    // shared by all of them, see SummaryEnvironment::LookupFunctionInfo
+    // NOTE constraints depend on the smt context of the analyzing thread, thus aren't kept here
+    struct FunctionAnalysisInfo
+    {
+        FunctionNumbering numbering;
+
+        FunctionControlFlowInfo ctrl_flow_info;
+
+        BlockMemorySSA memory_ssa;
+
+        // NOTE refers to memory_ssa in sparse mode
+        BlockDefUseIndex def_use;
+
+        // pointer nest level of each input of the summary
+        std::vector<int> ptr_nest_levels;
+
+        // pairs of inputs (i, j) with j < i that are assumed to never alias
+        std::vector<std::pair<int, int>> rejected_aliases;
+
+        FunctionAnalysisInfo(const FunctionSummary& summary);
+
+        FunctionAnalysisInfo(const FunctionAnalysisInfo&)            = delete;
+        FunctionAnalysisInfo& operator=(const FunctionAnalysisInfo&) = delete;
+    };
 
     class AnalysisContext
     {
@@ -26,9 +125,9 @@ namespace mh
 
         const FunctionSummary* current_summary_;
 
-        ConstraintSolver smt_solver_;
+        const FunctionAnalysisInfo& info_;
 
-        FunctionControlFlowInfo ctrl_flow_info_;
+        ConstraintSolver smt_solver_;
 
         // abstract store at the entry point of the function
         AbstractStore entry_store_;
@@ -36,11 +135,28 @@ namespace mh
         // consequent register file up to the point of the analysis
         AbstractRegFile regfile_;
 
-        // consequent store after a specific basic block up to the point of the analysis
-        std::unordered_map<const llvm::BasicBlock*, AbstractStore> exec_store_cache_;
+        // tables of blocks below are indexed by block numbers, see FunctionNumbering
 
-        // alias mapping for cast/ptr operations
-        std::unordered_map<const llvm::Value*, const llvm::Value*> alias_map_;
+        // consequent store after a specific basic block up to the point of the analysis, absent
+        // if the block hasn't run
+        // NOTE in sparse mode, only blocks owning stores are present, see LookupStoreOwner
+        std::vector<std::optional<AbstractStore>> exec_store_cache_;
+
+        // locations loaded by a MemoryUse block in its last execution, absent if it hasn't run
+        std::vector<std::optional<std::vector<AbstractLocation>>> block_loaded_locs_;
+
+        // locations updated in stores of predecessors since the last execution of a block
+        std::vector<std::unordered_set<AbstractLocation>> pending_pass_locs_;
+
+        // blocks that read states updated by committed executions, and need to be re-executed
+        std::vector<const llvm::BasicBlock*> affected_blocks_;
+
+        // locations that may represent more than one concrete memory region, e.g. allocations in
+        // loops or arrays, which can never be strongly updated
+        std::unordered_set<AbstractLocation> summary_locs_;
+
+        // alias mapping for cast/ptr operations, by value numbers, null if not aliased
+        std::vector<const llvm::Value*> alias_map_;
 
         AbstractStore result_store_;
 
@@ -49,14 +165,23 @@ namespace mh
                            std::unordered_map<AbstractLocation, Constraint>>
             update_hitory_;
 
-        std::unordered_map<const llvm::BasicBlock*, ConstrainedDataDependencyGraph> data_dep_cache_;
 
-    public:
-        // (read, write) -> constraint
-        std::map<std::pair<const llvm::Instruction*, const llvm::Value*>, Constraint>
-            data_dep_result_;
+        // scratch buffers for walks over dereference chains during instantiation
+        std::vector<std::pair<AbstractLocation, Constraint>> deref_walk_buffer_;
+        std::vector<std::pair<AbstractLocation, Constraint>> deref_walk_pointed_buffer_;
 
+        // last instantiation of callee summaries at each call site
+        std::unordered_map<const llvm::Instruction*, InvocationRecord> invocation_cache_;
+
+        // estimated memory held by this context, only tracked if memory accounting is enabled
+        MemoryUsage memory_usage_;
+
+        // set once a budget of the analysis is exhausted, see AnalyzeFunctionBlocks
+        bool degraded_ = false;
+
+    public:
         friend class AbstractExecution;
+        friend class DataDependencyAnalysis;
 
     public:
         auto Func() const noexcept { return current_summary_->func; }
@@ -67,8 +192,16 @@ namespace mh
 
         auto& Solver() noexcept { return smt_solver_; }
 
+        auto& ControlFlowInfo() const noexcept { return info_.ctrl_flow_info; }
+
+        auto& Numbering() const noexcept { return info_.numbering; }
+
     public:
         AnalysisContext(const SummaryEnvironment* env, const FunctionSummary* summary);
+        ~AnalysisContext();
+
+        AnalysisContext(const AnalysisContext&)            = delete;
+        AnalysisContext& operator=(const AnalysisContext&) = delete;
 
         PointToMap& LookupRegFile(const llvm::Value* reg)
         {
@@ -82,11 +215,11 @@ namespace mh
             return pt_map;
         }
 
-        bool UpdateRegFile(const llvm::Value* reg, PointToMap pt_map, bool force_update = false)
+        bool UpdateRegFile(const llvm::Value* reg, PointToMap pt_map)
         {
             PointToMap& cell = LookupRegFile(reg);
 
-            if (force_update || !EqualPointToMap(Solver(), cell, pt_map))
+            if (!EqualPointToMap(Solver(), cell, pt_map))
             {
                 cell = std::move(pt_map);
                 return true;
@@ -95,15 +228,17 @@ namespace mh
             return false;
         }
 
-        void AssignAliasReg(const llvm::Value* reg, const llvm::Value* alias_target)
+        // NOTE reg must be an instruction of the function
+        void AssignAliasReg(const llvm::Instruction* reg, const llvm::Value* alias_target)
         {
-            alias_map_[reg] = alias_target;
+            alias_map_[Numbering().ValueNumber(reg)] = alias_target;
         }
         const llvm::Value* TranslateAliasReg(const llvm::Value* reg)
         {
-            if (auto it = alias_map_.find(reg); it != alias_map_.end())
+            if (int number = Numbering().ValueNumber(reg);
+                number != FunctionNumbering::kNoNumber && alias_map_[number] != nullptr)
             {
-                return it->second;
+                return alias_map_[number];
             }
             else
             {
@@ -111,6 +246,42 @@ namespace mh
             }
         }
 
+        /**
+         * Lookup the block whose entry in exec_store_cache_ holds the store after a block, by
+         * block numbers
+         */
+        int LookupStoreOwner(int block) const
+        {
+            return AnalysisOptions::Current().sparse_store
+                       ? info_.memory_ssa.LookupStoreOwner(block)
+                       : block;
+        }
+
+        /**
+         * Number of locations in the store after bb
+         */
+        size_t NumStoreLocations(const llvm::BasicBlock* bb) const
+        {
+            int owner = LookupStoreOwner(Numbering().BlockNumber(bb));
+            return exec_store_cache_[owner] ? exec_store_cache_[owner]->size() : 0;
+        }
+
+        // if updates are widened for running out of a budget, the result is still sound but
+        // constraints of edges updated since then are lost
+        bool Degraded() const noexcept { return degraded_; }
+        void Degrade() noexcept { degraded_ = true; }
+
+        void MarkSummaryLocation(const AbstractLocation& loc) { summary_locs_.insert(loc); }
+        bool IsSummaryLocation(const AbstractLocation& loc) const
+        {
+            return summary_locs_.find(loc) != summary_locs_.end();
+        }
+
+        const std::unordered_set<AbstractLocation>& SummaryLocations() const noexcept
+        {
+            return summary_locs_;
+        }
+
         AbstractLocation RelabelLocation(AbstractLocation loc, const llvm::Instruction* inst)
         {
             int call_pt = env_->ComputeCallPoint(inst, loc.CallPoint());
@@ -124,30 +295,79 @@ namespace mh
 
         /**
          * Try to update the execution result. Returns true if the program state of `exec` differs
-         * from the previous run
+         * from the previous run, and blocks reading the updated states are marked affected
          */
         bool CommitExecution(const llvm::BasicBlock* bb, std::unique_ptr<AbstractExecution> exec);
 
         /**
          * Update abstract store with analysis of the basic block given. Returns true if consequnt
-         * program state is updated
+         * program state is updated. If `widen` is set, updates are widened against the previous
+         * analysis of the block.
          */
-        bool AnalyzeBlock(const llvm::BasicBlock* bb);
+        bool AnalyzeBlock(const llvm::BasicBlock* bb, bool widen = false);
 
-        bool AnalyzeBlock_DataDep(const llvm::BasicBlock* bb);
+        /**
+         * Take blocks affected by updates since the last call, see CommitExecution
+         */
+        std::vector<const llvm::BasicBlock*> TakeAffectedBlocks()
+        {
+            return std::exchange(affected_blocks_, {});
+        }
 
         /**
-         * Build the abstract store after completion of analysis. Note the context object will
-         * enter an invalid state after calling this function and should not be used later.
+         * Build the abstract store after completion of analysis. Note unless `keep_state` is set,
+         * the context object will enter an invalid state after calling this function and should
+         * not be used later.
          */
-        void BuildResultStore();
+        void BuildResultStore(bool keep_state = false);
 
         AbstractStore& ExportResultStore() { return result_store_; }
 
         void ExportRAWDependency();
 
+        const MemoryUsage& LocalMemoryUsage() const noexcept { return memory_usage_; }
+
         void DebugPrint(const llvm::BasicBlock* bb);
+
+    private:
+        // replace `old_bytes` accounted for `category` with `new_bytes`, both in this context and
+        // in the process-wide accounting
+        void AccountMemory(MemoryCategory category, size_t old_bytes, size_t new_bytes)
+        {
+            memory_usage_.Reallocate(category, old_bytes, new_bytes);
+            MemoryAccounting::Current().Reallocate(category, old_bytes, new_bytes);
+        }
+
+        void MarkAffectedBlocks(const std::vector<const llvm::BasicBlock*>& blocks)
+        {
+            affected_blocks_.insert(affected_blocks_.end(), blocks.begin(), blocks.end());
+        }
     };
 
     void AnalyzeFunction(SummaryEnvironment& env, const llvm::Function* func);
+
+    /**
+     * Run the intraprocedural fixpoint in ctx from the dirty blocks. If `scope` is not null,
+     * affected blocks are only re-analyzed if they are in the scope, which must be closed under
+     * predecessors. Summaries of functions called in analyzed blocks must be ready.
+     *
+     * If a budget of AnalysisOptions is exhausted, ctx is degraded and every later update is
+     * widened against the previous visit of its block.
+     */
+    void AnalyzeFunctionBlocks(AnalysisContext& ctx,
+                               std::unordered_set<const llvm::BasicBlock*> dirty,
+                               const std::unordered_set<const llvm::BasicBlock*>* scope = nullptr);
+
+    // run body(i) for each i in [0, n), and return after all of them complete
+    using ParallelForFunction = std::function<void(int n, const std::function<void(int)>& body)>;
+
+    /**
+     * Analyze functions of a recursive call graph SCC with chaotic iteration in rounds. In every
+     * round, scheduled members are analyzed through `parallel_for` against summaries of the
+     * previous round, and members calling a member updated in the round are scheduled for the
+     * next one. Summaries of the SCC are published, see SummaryEnvironment::PublishSummary.
+     */
+    void AnalyzeRecursiveComponent(SummaryEnvironment& env,
+                                   const std::vector<const llvm::Function*>& funcs,
+                                   const ParallelForFunction& parallel_for);
 } // namespace mh
@@ -0,0 +1,115 @@
+#pragma once
+#include "datadep.h"
+#include "store.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace mh
+{
+    class FunctionSummary;
+    class SummaryEnvironment;
+
+    // a converged summary loaded from SummaryCache
+    struct CachedSummary
+    {
+        AbstractStore store;
+        std::unordered_set<AbstractLocation> summary_locs;
+        DataDependencyCounts counts;
+
+        // call points collapsed when the summary was saved, see SummaryCache::RestoreCallPoints
+        std::vector<int> collapsed_call_points;
+    };
+
+    // Persistent cache of converged summaries across runs, one .hsum file per summary
+    //
+    // A summary is keyed by a hash of the IR of its function and fingerprints of the summaries of
+    // its called functions, so that a function is only re-analyzed if itself or the effect of one
+    // of its callees changed. Locations are written as names of their definitions and positions
+    // in their functions, call points as chains of call instructions, and constraints as DAGs of
+    // alias predicates over input variables, with an SMT-LIB fallback for other terms.
+    //
+    // The cache also keeps a record of the latest summary of each function. When a function is
+    // re-analyzed and its new summary equals the previous one, the previous summary is kept, so
+    // that its fingerprint and thus keys of its callers are unchanged. Changes in a module only
+    // propagate to callers of functions whose summary changes.
+    // NOTE summaries of recursive functions are neither loaded nor saved
+    class SummaryCache
+    {
+    private:
+        std::string directory_;
+
+        std::mutex mutex_;
+
+        // instructions of each function in program order, for position lookup
+        std::unordered_map<const llvm::Function*, std::vector<const llvm::Instruction*>>
+            instructions_;
+        std::unordered_map<const llvm::Instruction*, int> instruction_index_;
+
+        // fingerprints of summaries with their versions, and keys of functions
+        std::unordered_map<const llvm::Function*, std::pair<int, uint64_t>> fingerprints_;
+        std::unordered_map<const llvm::Function*, uint64_t> keys_;
+
+        std::atomic<int> num_hits_      = 0;
+        std::atomic<int> num_misses_    = 0;
+        std::atomic<int> num_unchanged_ = 0;
+
+    public:
+        SummaryCache(std::string directory);
+
+        // load the summary of a function saved by a previous run, if its key is unchanged
+        // constraints are created in the smt context of the current thread
+        std::optional<CachedSummary> Load(const SummaryEnvironment& env,
+                                          const FunctionSummary& summary);
+
+        // load the latest summary saved for a function, regardless of its key
+        // NOTE call points are restored only if the summary is used, see RestoreCallPoints
+        std::optional<CachedSummary> LoadPrevious(const SummaryEnvironment& env,
+                                                  const FunctionSummary& summary);
+
+        // collapse call points of a summary returned by LoadPrevious, once it's used
+        void RestoreCallPoints(const SummaryEnvironment& env, const CachedSummary& cached);
+
+        // count a re-analyzed function whose summary equals the previous one
+        void NotifyUnchanged();
+
+        // save a converged summary, summaries referring to unnamed values are skipped
+        void Save(const SummaryEnvironment& env, const FunctionSummary& summary,
+                  const DataDependencyCounts& counts);
+
+        int NumHits() const noexcept { return num_hits_.load(); }
+        int NumMisses() const noexcept { return num_misses_.load(); }
+        int NumUnchanged() const noexcept { return num_unchanged_.load(); }
+
+        // position of an instruction in its function, or its inverse
+        int InstructionIndex(const llvm::Instruction* inst);
+        const llvm::Instruction* InstructionAt(const llvm::Function* func, int index);
+
+    private:
+        // hash of the function IR, analysis options and fingerprints of called summaries
+        // nullopt if the summary of a callee can't be fingerprinted
+        std::optional<uint64_t> ComputeKey(const SummaryEnvironment& env,
+                                           const FunctionSummary& summary);
+
+        // stable hash of the content of a summary, independent of the run and the smt context
+        // nullopt if the summary refers to values that can't be named
+        std::optional<uint64_t> ComputeFingerprint(const SummaryEnvironment& env,
+                                                   const FunctionSummary& summary);
+
+        std::optional<CachedSummary> ReadCacheFile(const SummaryEnvironment& env,
+                                                   const FunctionSummary& summary, uint64_t key);
+
+        std::string CacheFilePath(uint64_t key) const;
+        std::string FunctionRecordPath(const llvm::Function* func) const;
+
+        // NOTE mutex_ must be held
+        void IndexInstructions(const llvm::Function* func);
+    };
+} // namespace mh
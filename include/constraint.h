@@ -1,11 +1,23 @@
 #pragma once
 #include "utils.h"
 #include "z3++.h"
+#include <cstdint>
 #include <set>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <chrono>
+#include <unordered_map>
 
 namespace mh
 {
-    // TODO: support multi-threading
+    extern thread_local double g_check_ms;
+    extern thread_local double g_fresh_ms;
+    extern thread_local const char* g_tag;
+    // Smt context of the current thread
+    // NOTE z3 contexts are not thread-safe, constraints must be translated before being used in
+    // another thread, see Constraint::Translate
     class SmtProvider
     {
     private:
@@ -64,6 +76,12 @@ namespace mh
         }
 
         z3::expr CreateNoAliasExpr(int loc_i, int loc_j) { return !CreateAliasExpr(loc_i, loc_j); }
+
+        // index i of an alias variable x_i, or -1 if the term is not an alias variable
+        static int AliasVariableIndex(const z3::expr& e);
+
+        // test if a term is x_i == x_j of two alias variables, as created by CreateAliasExpr
+        static bool IsAliasExpr(const z3::expr& e);
     };
 
     // TODO: try avoid redundent context storage
@@ -90,6 +108,14 @@ namespace mh
             return static_cast<Z3_ast>(may) == static_cast<Z3_ast>(must);
         }
 
+        // test if both constraints are built from the same terms
+        // NOTE z3 hash-conses its ASTs, so this is a cheap syntactic test without solver
+        bool IsIdentical(const Constraint& c) const noexcept
+        {
+            return static_cast<Z3_ast>(may) == static_cast<Z3_ast>(c.may) &&
+                   static_cast<Z3_ast>(must) == static_cast<Z3_ast>(c.must);
+        }
+
         bool IsTopLiteral() const noexcept { return HasSameMayMust() && must.is_true(); }
         bool IsBottomLiteral() const noexcept { return HasSameMayMust() && must.is_false(); }
 
@@ -98,6 +124,18 @@ namespace mh
         // lower bound, strongest constraint
         z3::expr GetMustExpr() const noexcept { return must; }
 
+        // translate terms into another smt context
+        Constraint Translate(z3::context& ctx) const
+        {
+            z3::expr may_translated{ctx, Z3_translate(may.ctx(), may, ctx)};
+            if (HasSameMayMust())
+            {
+                return Constraint{may_translated};
+            }
+
+            return Constraint{may_translated, z3::expr{ctx, Z3_translate(must.ctx(), must, ctx)}};
+        }
+
         // TODO: need a better name
         Constraint Weaken() const noexcept
         {
@@ -106,7 +144,7 @@ namespace mh
 
         Constraint Combine(const Constraint& c) const noexcept
         {
-            return Constraint{may || c.may, must && c.must};
+            return Constraint{MakeOr(may, c.may), MakeAnd(must, c.must)};
         }
 
         void Simplify() noexcept
@@ -136,25 +174,127 @@ namespace mh
 
         friend Constraint operator&&(const Constraint& lhs, const Constraint& rhs)
         {
-            return Constraint{lhs.may && rhs.may, lhs.must && rhs.must};
+            return Constraint{MakeAnd(lhs.may, rhs.may), MakeAnd(lhs.must, rhs.must)};
         }
         friend Constraint operator||(const Constraint& lhs, const Constraint& rhs)
         {
-            return Constraint{lhs.may || rhs.may, lhs.must || rhs.must};
+            return Constraint{MakeOr(lhs.may, rhs.may), MakeOr(lhs.must, rhs.must)};
+        }
+        friend Constraint operator!(const Constraint& c) { return Constraint{MakeNot(c.must), MakeNot(c.may)}; }
+        static z3::expr MakeNot(const z3::expr& a)
+        {
+            static bool on = getenv("HA_NOT") != nullptr;
+            if (on)
+            {
+                if (a.is_true()) return a.ctx().bool_val(false);
+                if (a.is_false()) return a.ctx().bool_val(true);
+                if (a.is_not()) return a.arg(0);
+            }
+            return !a;
+        }
+
+    private:
+        // NOTE z3 hash-conses its asts, so identical terms share the same node
+        static bool SameAst(const z3::expr& a, const z3::expr& b) noexcept
+        {
+            return static_cast<Z3_ast>(a) == static_cast<Z3_ast>(b);
+        }
+
+        // test if term a is a direct operand of b, which is of the given kind
+        static bool IsOperandOf(const z3::expr& a, const z3::expr& b, Z3_decl_kind kind)
+        {
+            if (!b.is_app() || b.decl().decl_kind() != kind)
+            {
+                return false;
+            }
+
+            for (unsigned i = 0; i < b.num_args(); ++i)
+            {
+                if (SameAst(a, b.arg(i)))
+                {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        // make a || b without stacking up terms the disjunction already covers
+        // NOTE constraints are re-combined with themselves on every fixpoint iteration, without
+        // this the formulas grow with the number of iterations instead of the number of paths
+        static z3::expr MakeOr(const z3::expr& a, const z3::expr& b)
+        {
+            if (SameAst(a, b) || a.is_true() || b.is_false() || IsOperandOf(b, a, Z3_OP_OR))
+            {
+                return a;
+            }
+            if (b.is_true() || a.is_false() || IsOperandOf(a, b, Z3_OP_OR))
+            {
+                return b;
+            }
+            static bool abs = getenv("HA_ABS") != nullptr;
+            if (abs && IsOperandOf(a, b, Z3_OP_AND)) return a;
+            if (abs && IsOperandOf(b, a, Z3_OP_AND)) return b;
+
+            if (getenv("HA_CANON")) return MakeJunction(a, b, Z3_OP_OR);
+            return a || b;
+        }
+
+        // make a && b, see MakeOr
+        static z3::expr MakeAnd(const z3::expr& a, const z3::expr& b)
+        {
+            if (SameAst(a, b) || a.is_false() || b.is_true() || IsOperandOf(b, a, Z3_OP_AND))
+            {
+                return a;
+            }
+            if (b.is_false() || a.is_true() || IsOperandOf(a, b, Z3_OP_AND))
+            {
+                return b;
+            }
+            static bool abs = getenv("HA_ABS") != nullptr;
+            if (abs && IsOperandOf(a, b, Z3_OP_OR)) return a;
+            if (abs && IsOperandOf(b, a, Z3_OP_OR)) return b;
+
+            if (getenv("HA_CANON")) return MakeJunction(a, b, Z3_OP_AND);
+            return a && b;
+        }
+        static void AppendOperands(const z3::expr& e, Z3_decl_kind kind, std::vector<z3::expr>& out)
+        {
+            if (e.is_app() && e.decl().decl_kind() == kind)
+                for (unsigned i = 0; i < e.num_args(); ++i) out.push_back(e.arg(i));
+            else out.push_back(e);
+        }
+        static z3::expr MakeJunction(const z3::expr& a, const z3::expr& b, Z3_decl_kind kind)
+        {
+            std::vector<z3::expr> ops;
+            AppendOperands(a, kind, ops); AppendOperands(b, kind, ops);
+            std::vector<std::pair<unsigned, unsigned>> ids;
+            for (unsigned i = 0; i < ops.size(); ++i) ids.emplace_back(ops[i].id(), i);
+            std::sort(ids.begin(), ids.end());
+            z3::expr_vector v(a.ctx());
+            for (unsigned i = 0; i < ids.size(); ++i) if (i == 0 || ids[i].first != ids[i-1].first) v.push_back(ops[ids[i].second]);
+            if (v.size() == 1) return v[0];
+            return kind == Z3_OP_OR ? z3::mk_or(v) : z3::mk_and(v);
         }
-        friend Constraint operator!(const Constraint& c) { return Constraint{!c.must, !c.may}; }
     };
 
     class ConstraintSolver
     {
     private:
         SmtProvider* provider = &SmtProvider::Current();
-        z3::solver solver     = z3::solver{SmtProvider::Current().Context()};
+        z3::solver solver     = getenv("HA_SIMPLE") ? z3::solver{SmtProvider::Current().Context(), z3::solver::simple()} : getenv("HA_LIA") ? z3::solver{SmtProvider::Current().Context(), "QF_LIA"} : getenv("HA_TAC") ? (z3::tactic(SmtProvider::Current().Context(), "simplify") & z3::tactic(SmtProvider::Current().Context(), "smt")).mk_solver() : z3::solver{SmtProvider::Current().Context()};
 
         int num_inputs_;
         std::vector<z3::expr> input_loc_vars_;
         std::vector<bool> alias_rej_list_;
 
+        // number of queries dispatched to z3, i.e. not decided by literals or the cache
+        int64_t num_queries_ = 0;
+
+        // satisfiability of the terms already dispatched to z3, by ast id
+        // NOTE the term is kept to pin its id, z3 recycles the ids of released asts
+        std::unordered_map<unsigned, std::pair<z3::expr, bool>> sat_cache_;
+
     public:
         ConstraintSolver(int num_inputs)
         {
@@ -169,6 +309,8 @@ namespace mh
             }
         }
 
+        int64_t NumQueries() const noexcept { return num_queries_; }
+
         // test if a constraint could hold
         bool TestSatisfiability(const Constraint& c);
 
@@ -195,12 +337,27 @@ namespace mh
         Constraint MakeAliasConstraint(int i, int j);
 
     private:
-        bool TestSatisfiablityAux(z3::expr expr) { return solver.check(1, &expr) == z3::sat; }
-        bool TestValidityAux(z3::expr expr)
+        // the fixpoint keeps asking about the same terms, so results are looked up by ast first
+        bool TestSatisfiablityAux(z3::expr expr)
         {
-            z3::expr c_expr = !expr;
-            return solver.check(1, &c_expr) == z3::unsat;
+            auto it = sat_cache_.find(expr.id());
+            if (it != sat_cache_.end())
+            {
+                return it->second.second;
+            }
+
+            num_queries_ += 1; extern thread_local const char* g_tag; extern std::map<std::string,int> g_tagc; g_tagc[g_tag]++;
+            auto t0 = std::chrono::steady_clock::now();
+            static int mode = getenv("HA_SMODE") ? atoi(getenv("HA_SMODE")) : 0;
+            bool sat;
+            if (mode == 1) { solver.push(); solver.add(expr); sat = solver.check() == z3::sat; solver.pop(); }
+            else sat = solver.check(1, &expr) == z3::sat;
+            if (getenv("HA_FRESH")) { auto t1 = std::chrono::steady_clock::now(); z3::solver f(expr.ctx()); for (auto a : solver.assertions()) f.add(a); f.check(1, &expr); extern thread_local double g_fresh_ms; g_fresh_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t1).count(); t0 += std::chrono::steady_clock::now() - t1; }
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count(); g_check_ms += ms; if (getenv("HA_DUMP")) fprintf(stderr, "Q %.3f ms sat=%d %s\n", ms, (int)sat, expr.to_string().substr(0, 300).c_str());
+            sat_cache_.emplace(expr.id(), std::make_pair(expr, sat));
+            return sat;
         }
+        bool TestValidityAux(z3::expr expr) { return !TestSatisfiablityAux(!expr); }
         bool TestImplicationAux(z3::expr e0, z3::expr e1)
         {
             return TestValidityAux(z3::implies(e0, e1));
@@ -1,8 +1,11 @@
 #pragma once
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/IR/Function.h"
-#include <set>
-#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
 #include <unordered_set>
+#include <vector>
 
 namespace mh
 {
@@ -13,31 +16,223 @@ namespace mh
         Must,
     };
 
+    // Dense numbers of blocks and values defined in a function, so that per-function tables are
+    // flat vectors indexed by numbers rather than hash maps keyed by pointers
+    //
+    // Blocks are numbered in function order. Arguments are numbered first, followed by instructions
+    // in function order, thus instructions of a block are numbered by their order in the block.
+    // Other values, i.e. globals and constants, have no number.
+    class FunctionNumbering
+    {
+    private:
+        std::vector<const llvm::BasicBlock*> blocks_;
+        std::vector<const llvm::Value*> values_;
+
+        llvm::DenseMap<const llvm::BasicBlock*, int> block_numbers_;
+        llvm::DenseMap<const llvm::Value*, int> value_numbers_;
+
+    public:
+        static constexpr int kNoNumber = -1;
+
+        FunctionNumbering(const llvm::Function* func);
+
+        int NumBlocks() const noexcept { return blocks_.size(); }
+
+        int NumValues() const noexcept { return values_.size(); }
+
+        const llvm::BasicBlock* Block(int number) const { return blocks_[number]; }
+
+        const llvm::Value* Value(int number) const { return values_[number]; }
+
+        // NOTE bb must be a block of the function
+        int BlockNumber(const llvm::BasicBlock* bb) const
+        {
+            return block_numbers_.find(bb)->second;
+        }
+
+        // kNoNumber if val is not an argument or an instruction of the function
+        int ValueNumber(const llvm::Value* val) const
+        {
+            auto it = value_numbers_.find(val);
+            return it != value_numbers_.end() ? it->second : kNoNumber;
+        }
+    };
+
+    // Bourdoncle's weak topological ordering of basic blocks, i.e. a hierarchical ordering where
+    // every strongly connected component is nested under a head, and every back edge jumps to the
+    // head of an enclosing component
+    //
+    // Blocks are stored in a flat sequence, a component spans from its head to the index returned
+    // by ComponentEnd. Blocks unreachable from the entry are ordered after reachable blocks.
+    class WeakTopologicalOrder
+    {
+    private:
+        std::vector<const llvm::BasicBlock*> order_;
+
+        // index past the last block of the component headed by the block, or the next index for a
+        // block that is not a head
+        std::vector<int> component_end_;
+
+        std::unordered_set<const llvm::BasicBlock*> heads_;
+
+    public:
+        WeakTopologicalOrder(const llvm::Function* func);
+
+        int Size() const noexcept { return order_.size(); }
+
+        const llvm::BasicBlock* At(int index) const { return order_[index]; }
+
+        int ComponentEnd(int index) const { return component_end_[index]; }
+
+        bool IsLoopHead(const llvm::BasicBlock* bb) const
+        {
+            return heads_.find(bb) != heads_.end();
+        }
+
+        /**
+         * Analyze dirty blocks with the recursive iteration strategy until no block is dirty.
+         * `analyze(bb, num_visit)` is called on a dirty block after it's cleaned, and it marks
+         * blocks affected by the analysis dirty. Stabilization of a component is only checked at
+         * its head, where `num_visit` counts analyses of the head in the current stabilization.
+         */
+        template <typename F>
+        void Iterate(std::unordered_set<const llvm::BasicBlock*>& dirty, F analyze) const
+        {
+            auto iterate_range = [&](int begin, int end, auto& self) -> void {
+                for (int i = begin; i < end; i = component_end_[i])
+                {
+                    const llvm::BasicBlock* bb = order_[i];
+                    if (!IsLoopHead(bb))
+                    {
+                        if (dirty.erase(bb) > 0)
+                        {
+                            analyze(bb, 1);
+                        }
+
+                        continue;
+                    }
+
+                    // stabilize the component, a change fed back to the head repeats the body
+                    int num_visit = 0;
+                    do
+                    {
+                        if (dirty.erase(bb) > 0)
+                        {
+                            analyze(bb, ++num_visit);
+                        }
+
+                        self(i + 1, component_end_[i], self);
+                    } while (dirty.find(bb) != dirty.end());
+                }
+            };
+
+            // blocks preceding in the order could still be dirtied by blocks not jumping back to
+            // them, e.g. unreachable blocks that are ordered last
+            while (!dirty.empty())
+            {
+                iterate_range(0, Size(), iterate_range);
+            }
+        }
+    };
+
+    // Square bit matrix over numbered blocks, with rows packed into 64-bit words so that rows are
+    // combined a word at a time
+    class BlockBitMatrix
+    {
+    private:
+        int num_words_ = 0;
+        std::vector<uint64_t> words_;
+
+    public:
+        BlockBitMatrix(int size = 0)
+            : num_words_((size + 63) / 64), words_(static_cast<size_t>(size) * num_words_)
+        {
+        }
+
+        bool Test(int row, int col) const
+        {
+            return (words_[Offset(row) + col / 64] >> (col % 64)) & 1;
+        }
+
+        void Set(int row, int col) { words_[Offset(row) + col / 64] |= uint64_t{1} << (col % 64); }
+
+        // row |= other row of the matrix, returns true if the row changed
+        bool UnionRow(int row, int other_row)
+        {
+            uint64_t* dst       = &words_[Offset(row)];
+            const uint64_t* src = &words_[Offset(other_row)];
+
+            uint64_t changed = 0;
+            for (int k = 0; k < num_words_; ++k)
+            {
+                changed |= src[k] & ~dst[k];
+                dst[k] |= src[k];
+            }
+
+            return changed != 0;
+        }
+
+        // row &= other row of another matrix of the same size
+        void IntersectRow(int row, const BlockBitMatrix& other, int other_row)
+        {
+            uint64_t* dst       = &words_[Offset(row)];
+            const uint64_t* src = &other.words_[other.Offset(other_row)];
+            for (int k = 0; k < num_words_; ++k)
+            {
+                dst[k] &= src[k];
+            }
+        }
+
+        // row = other row of another matrix of the same size
+        void AssignRow(int row, const BlockBitMatrix& other, int other_row)
+        {
+            std::copy_n(&other.words_[other.Offset(other_row)], num_words_,
+                        &words_[Offset(row)]);
+        }
+
+    private:
+        size_t Offset(int row) const { return static_cast<size_t>(row) * num_words_; }
+    };
+
     class FunctionControlFlowInfo
     {
     private:
-        // (source, target)
-        // cache for quickly determing if a control edge is jumping backward
-        using ControlFlowEdge = std::pair<const llvm::BasicBlock*, const llvm::BasicBlock*>;
-        std::set<ControlFlowEdge> backedges_;
+        const llvm::Function* func_;
 
-        using ExecAfterConditionMap =
-            std::unordered_map<const llvm::BasicBlock*, ExecAfterCondition>;
-        std::unordered_map<const llvm::BasicBlock*, ExecAfterConditionMap> exec_after_lookup_;
+        const FunctionNumbering& numbering_;
 
-        // for two instruction inst1, inst2 in the same basic block
-        // guranteed that inst1 comes before inst2 if f(inst1) < f(inst2)
-        std::unordered_map<const llvm::Instruction*, int> inst_index_lookup_;
+        // sources of back edges jumping to each block, i.e. edges loop back, by block numbers
+        std::vector<std::vector<int>> backedge_sources_;
+
+        WeakTopologicalOrder wto_;
+
+        // execution orders are only computed on the first lookup, as they are quadratic in the
+        // number of blocks
+        mutable std::once_flag exec_after_once_;
+
+        // (src, dst) is set if dst may execute after src, i.e. reachable by at least one edge
+        mutable BlockBitMatrix may_exec_after_;
+
+        // (src, dst) is set if dst must execute after src, i.e. it post-dominates all successors
+        // of src, NOTE a subset of may_exec_after_
+        mutable BlockBitMatrix must_exec_after_;
 
     public:
-        FunctionControlFlowInfo(const llvm::Function* func);
+        // NOTE numbering must outlive this object
+        FunctionControlFlowInfo(const llvm::Function* func, const FunctionNumbering& numbering);
+
+        /**
+         * Weak topological order of basic blocks in the function, computed once
+         */
+        const WeakTopologicalOrder& Wto() const noexcept { return wto_; }
 
         /**
-         * Test if the control edge (src -> dst) is a back edge(loop back)
+         * Test if the control edge (src -> dst) between numbered blocks is a back edge(loop back)
          */
-        bool IsBackEdge(const llvm::BasicBlock* src, const llvm::BasicBlock* dst)
+        bool IsBackEdge(int src, int dst) const
         {
-            return backedges_.find(std::pair{src, dst}) != backedges_.end();
+            const std::vector<int>& sources = backedge_sources_[dst];
+            return std::find(sources.begin(), sources.end(), src) != sources.end();
         }
 
         /**
@@ -46,15 +241,17 @@ namespace mh
         ExecAfterCondition LookupExecAfterCondition(const llvm::BasicBlock* src,
                                                     const llvm::BasicBlock* dst) const
         {
-            const auto& lookup = exec_after_lookup_.at(src);
-            if (auto it = lookup.find(dst); it != lookup.end())
-            {
-                return it->second;
-            }
-            else
+            EnsureExecAfterLookup();
+
+            int index_src = numbering_.BlockNumber(src);
+            int index_dst = numbering_.BlockNumber(dst);
+            if (must_exec_after_.Test(index_src, index_dst))
             {
-                return ExecAfterCondition::Never;
+                return ExecAfterCondition::Must;
             }
+
+            return may_exec_after_.Test(index_src, index_dst) ? ExecAfterCondition::May
+                                                              : ExecAfterCondition::Never;
         }
 
         /**
@@ -66,23 +263,24 @@ namespace mh
             const llvm::BasicBlock* bb_src = src->getParent();
             const llvm::BasicBlock* bb_dst = dst->getParent();
 
-            if (bb_src == bb_dst)
+            // instructions of a block are numbered in order
+            if (bb_src == bb_dst && numbering_.ValueNumber(src) < numbering_.ValueNumber(dst))
             {
-                return inst_index_lookup_.at(src) < inst_index_lookup_.at(dst)
-                           ? ExecAfterCondition::Must
-                           : LookupExecAfterCondition(bb_src, bb_dst);
-            }
-            else
-            {
-                return LookupExecAfterCondition(bb_src, bb_dst);
+                return ExecAfterCondition::Must;
             }
+
+            return LookupExecAfterCondition(bb_src, bb_dst);
         }
 
     private:
-        void ComputeBackEdges(const llvm::Function* func);
+        void ComputeBackEdges();
 
-        void ComputeExecAfterLookup(const llvm::Function* func);
+        // NOTE thread-safe, so that the info can be shared by analyses in different threads
+        void EnsureExecAfterLookup() const
+        {
+            std::call_once(exec_after_once_, [this] { ComputeExecAfterLookup(); });
+        }
 
-        void ComputeInstructionIndexLookup(const llvm::Function* func);
+        void ComputeExecAfterLookup() const;
     };
 }; // namespace mh
\ No newline at end of file
@@ -0,0 +1,97 @@
+#pragma once
+#include "constraint.h"
+#include "controlflow.h"
+#include "options.h"
+#include "store.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace mh
+{
+    class AnalysisContext;
+
+    // (load, source of the loaded value) -> constraint
+    // sources are stores, calls writing the location, allocations and inputs of the function
+    using DataDependencyMap =
+        std::map<std::pair<const llvm::Instruction*, const llvm::Value*>, Constraint>;
+
+    // numbers of read-after-write dependencies of a function
+    struct DataDependencyCounts
+    {
+        int num_raw_store = 0;
+        int num_raw_call  = 0;
+        int num_raw_arg   = 0;
+    };
+
+    // RAW dependencies of a function
+    struct DataDependencyResult
+    {
+        DataDependencyMap edges;
+
+        DataDependencyCounts Count() const;
+    };
+
+    /**
+     * Test if RAW dependencies of converged functions are computed, always in debug mode
+     */
+    inline bool DataDependencyEnabled() noexcept
+    {
+#ifdef HEAP_ANALYSIS_DEBUG_MODE
+        return true;
+#else
+        return AnalysisOptions::Current().data_dependency;
+#endif
+    }
+
+    // Constrained data dependency analysis of a function, run as a separate stage after the
+    // point-to analysis of the function converges
+    //
+    // A graph from each location to the values that may have last written it is propagated
+    // forward over blocks, reading point-to maps of pointers from the converged result store and
+    // locations written by calls from their update history. Blocks are visited from a worklist in
+    // reverse post order, and a block is only recomputed if the graph after one of its predecessors
+    // changed, so that blocks after loops are visited once the loops are stable.
+    class DataDependencyAnalysis
+    {
+    private:
+        // NOTE must outlive this object, with BuildResultStore called
+        AnalysisContext& ctx_;
+
+        const FunctionNumbering& numbering_;
+
+        // reachable blocks in reverse post order, followed by unreachable blocks
+        std::vector<const llvm::BasicBlock*> order_;
+
+        // index into order_ of each block, by block numbers
+        std::vector<int> order_index_;
+
+        // graph after each block, by block numbers
+        std::vector<ConstrainedDataDependencyGraph> block_graphs_;
+
+        DataDependencyResult result_;
+
+    public:
+        DataDependencyAnalysis(AnalysisContext& ctx);
+        ~DataDependencyAnalysis();
+
+        DataDependencyAnalysis(const DataDependencyAnalysis&)            = delete;
+        DataDependencyAnalysis& operator=(const DataDependencyAnalysis&) = delete;
+
+        /**
+         * Compute RAW dependencies of the function
+         */
+        const DataDependencyResult& Run();
+
+    private:
+        /**
+         * Recompute the graph after bb and record dependencies of its loads. Returns true if the
+         * graph changed.
+         */
+        bool AnalyzeBlock(const llvm::BasicBlock* bb);
+
+        const PointToMap& LookupPointer(const llvm::Value* ptr) const;
+    };
+} // namespace mh
@@ -0,0 +1,68 @@
+#pragma once
+#include "summary.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/IR/Function.h"
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace mh
+{
+    // Analyzes strongly connected components of the call graph bottom-up on a pool of threads
+    //
+    // A component is dispatched as soon as all components it calls have converged summaries.
+    // Every worker keeps a deque of tasks, tasks submitted by a worker are pushed to its own deque,
+    // and idle workers steal from the others. Members of a recursive component are analyzed as
+    // nested tasks, see AnalyzeRecursiveComponent. Workers analyze with their own smt contexts,
+    // summaries are exchanged with SummaryEnvironment::PublishSummary.
+    class ParallelAnalysisDriver
+    {
+    private:
+        struct Component
+        {
+            std::vector<const llvm::Function*> funcs;
+
+            // components calling functions in this component
+            std::vector<int> callers;
+
+            // number of other components called by this component
+            int num_callees = 0;
+
+            // if functions in the component call each other or themselves
+            bool recursive = false;
+        };
+
+        SummaryEnvironment* env_;
+
+        int num_threads_;
+
+        std::vector<Component> components_;
+
+        std::unordered_map<const llvm::Function*, int> component_lookup_;
+
+    public:
+        ParallelAnalysisDriver(SummaryEnvironment* env, int num_threads);
+
+        /**
+         * Add a component of functions, components it calls must have been added before, i.e.
+         * components are added in bottom-up order as visited by CallGraphSCCPass
+         */
+        void AddComponent(std::vector<const llvm::Function*> funcs, bool recursive);
+
+        /**
+         * Analyze all components added, returns after every summary converges
+         * Once `cancelled` returns true, components not yet started are skipped and their
+         * summaries are left unconverged
+         */
+        void Run(const std::function<bool()>& cancelled = nullptr);
+    };
+
+    /**
+     * Analyze a strongly connected component of the call graph, components must be visited
+     * bottom-up. If `driver` is not null, the component is added to it instead, to be analyzed on
+     * ParallelAnalysisDriver::Run
+     */
+    void AnalyzeCallGraphSCC(SummaryEnvironment& env, ParallelAnalysisDriver* driver,
+                             llvm::ArrayRef<llvm::CallGraphNode*> scc);
+} // namespace mh
@@ -10,6 +10,26 @@ namespace mh
     struct FunctionSummary;
     class AnalysisContext;
 
+    // Memoized instantiation of a callee summary at a call site
+    // An instantiation only depends on the callee summary, point-to maps of the inputs and the slice
+    // of caller's store reachable from the inputs. If they are identical to the recorded ones, the
+    // recorded effects can be replayed instead of instantiating the summary again.
+    struct InvocationRecord
+    {
+        const FunctionSummary* summary = nullptr;
+        int summary_version            = 0;
+
+        // inputs of the instantiation
+        std::vector<PointToMap> input_pt_maps;
+        std::vector<std::pair<AbstractLocation, PointToMap>> store_slice;
+
+        // effects of the instantiation
+        std::vector<std::pair<AbstractLocation, PointToMap>> store_delta;
+        std::unordered_map<AbstractLocation, Constraint> update_history;
+        bool has_return = false;
+        PointToMap return_pt_map;
+    };
+
     class AbstractExecution
     {
     private:
@@ -17,12 +37,21 @@ namespace mh
 
         AbstractStore store_;
 
-        // track if any register is updated in this execution
-        bool reg_update_ = false;
+        // if not null, the execution defines no memory and reads this store instead of `store_`
+        const AbstractStore* shared_store_ = nullptr;
+
+        // registers point-to map of which are updated in this execution
+        std::vector<const llvm::Value*> updated_regs_;
 
         // track locations point-to map of which may be altered in this execution
         std::unordered_set<AbstractLocation> important_loc_;
 
+        // locations point-to map of which are read by loads in this execution
+        std::vector<AbstractLocation> loaded_locs_;
+
+        // widen updates against the previous execution, see WidenPointToMap
+        bool widen_ = false;
+
         friend class AnalysisContext;
 
     public:
@@ -30,6 +59,12 @@ namespace mh
             : ctx_(ctx), store_(std::move(init_store))
         {
         }
+        AbstractExecution(AnalysisContext* ctx, const AbstractStore* shared_store)
+            : ctx_(ctx), shared_store_(shared_store)
+        {
+        }
+
+        void EnableWidening() noexcept { widen_ = true; }
 
         // deprecated
         void DoAssign(const llvm::Instruction* reg, AbstractLocation loc);
@@ -54,10 +89,19 @@ namespace mh
         // *p = %?
         void DoStore(const llvm::Value* reg_val, const llvm::Value* reg_ptr);
 
-        // test if this execution updates abstract stores(including registers)
-        bool TestStoreUpdate(const AbstractStore& store_old);
+        // collect locations point-to map of which are updated by this execution, including those
+        // written here and `pass_locs` updated in stores of predecessors since the last execution
+        std::vector<AbstractLocation>
+        CollectUpdatedLocations(const AbstractStore& store_old,
+                                const std::unordered_set<AbstractLocation>& pass_locs);
 
     private:
+        // store to read from in this execution
+        const AbstractStore& ReadStore() const noexcept
+        {
+            return shared_store_ != nullptr ? *shared_store_ : store_;
+        }
+
         // mark a location that it may be updated in this execution
         void MarkLocationUpdate(AbstractLocation loc) { important_loc_.insert(loc); }
 
@@ -76,9 +120,18 @@ namespace mh
         ConstructArgParamMappingLookup(const FunctionSummary& called_summary,
                                        const std::vector<const llvm::Value*>& inputs);
 
-        void MergeInvocationStore(const llvm::Instruction* reg,
-                                  const FunctionSummary& called_summary, AbstractStore result_store,
-                                  ArgParamMappingLookup loc_mapping);
+        // returns locations of which point-to maps are rewritten
+        std::vector<AbstractLocation> MergeInvocationStore(const llvm::Instruction* reg,
+                                                           const FunctionSummary& called_summary,
+                                                           AbstractStore result_store,
+                                                           ArgParamMappingLookup loc_mapping);
+
+        // test if the recorded instantiation is still valid under the current execution state
+        bool TestInvocationRecord(const InvocationRecord& record,
+                                  const FunctionSummary& called_summary,
+                                  const std::vector<const llvm::Value*>& inputs);
+
+        void ReplayInvocationRecord(const llvm::Instruction* reg, const InvocationRecord& record);
     };
 
 } // namespace mh
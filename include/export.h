@@ -0,0 +1,98 @@
+#pragma once
+#include "constraint.h"
+#include "datadep.h"
+#include "location.h"
+#include "options.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+namespace mh
+{
+    class FunctionSummary;
+    class SummaryEnvironment;
+
+    // Streaming export of converged summaries and RAW dependencies for downstream tools
+    //
+    // Output is a sequence of records, either one JSON object per line, or a header "HEXP" with a
+    // version followed by binary records of a kind byte, a length and fields in the order below as
+    // zigzag varints and length-prefixed strings.
+    //
+    // Values are referred to by ids numbered in module order, i.e. globals, then each function
+    // followed by its arguments and instructions, so that ids are stable across runs of the same
+    // module. A value record naming the definition of an id is written before the first record
+    // referring to it, the same for call points.
+    //
+    // Records:
+    //   module     {name}, ids of the following records refer to this module
+    //   value      {id, kind, name | function + index}, kinds are 0 global, 1 function,
+    //              2 argument, 3 instruction and 4 constant
+    //   call_point {id, inst, prev}, NOTE call point ids depend on the order of analysis
+    //   summary    {function, constraints, store, summary_locs}
+    //   raw        {function, constraints, edges: [load, source, may, must]}
+    //
+    // A location is [tag, definition id or -1, deref level or call point]. Constraints of a
+    // record are a DAG of nodes [op, operands...], and an edge refers to a may and a must node.
+    // Ops are 0 false, 1 true, 2 not, 3 and, 4 or, 5 x_i == x_j, 6 other term in SMT-LIB.
+    class ResultExporter
+    {
+    private:
+        struct ValueInfo
+        {
+            uint64_t id;
+
+            // argument or instruction position in its function
+            int index = 0;
+
+            bool written = false;
+        };
+
+        std::unique_ptr<llvm::raw_ostream> os_;
+        ExportFormat format_;
+
+        std::mutex mutex_;
+
+        std::unordered_map<const llvm::Value*, ValueInfo> value_ids_;
+        uint64_t next_value_id_ = 0;
+
+        std::unordered_set<int> written_call_points_;
+
+    public:
+        ResultExporter(std::unique_ptr<llvm::raw_ostream> os, ExportFormat format);
+        ~ResultExporter();
+
+        // open a file to export into, null with `error` set on failure
+        static std::unique_ptr<ResultExporter> Create(const std::string& path, ExportFormat format,
+                                                      std::string& error);
+
+        // number values of a module, must be called before exporting results of its functions
+        // NOTE ids of a previous module are invalidated
+        void BeginModule(const llvm::Module& module);
+
+        // export a converged summary, constraints must be in the smt context of the current thread
+        void ExportSummary(const SummaryEnvironment& env, const FunctionSummary& summary);
+
+        // export RAW dependencies of a function
+        void ExportDataDependencies(const llvm::Function* func, const DataDependencyMap& deps);
+
+        void Flush();
+
+    private:
+        class RecordWriter;
+        class ConstraintTable;
+
+        // id of a value, its value record is written on first reference
+        // NOTE mutex_ must be held
+        uint64_t WriteValue(const llvm::Value* val);
+
+        // write the record of a call point and its predecessors on first reference
+        // NOTE mutex_ must be held
+        void WriteCallPoint(const SummaryEnvironment& env, int call_point);
+    };
+} // namespace mh
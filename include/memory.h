@@ -0,0 +1,137 @@
+#pragma once
+#include "options.h"
+#include "store.h"
+#include <array>
+#include <atomic>
+#include <string_view>
+#include <unordered_map>
+
+namespace mh
+{
+    // Subsystems of the analysis whose memory consumption is accounted
+    enum class MemoryCategory
+    {
+        // abstract stores after each basic block, i.e. AnalysisContext::exec_store_cache_
+        ExecStore,
+
+        // point-to maps of registers, i.e. AnalysisContext::regfile_
+        RegFile,
+
+        // function summaries kept in SummaryEnvironment
+        Summary,
+
+        // ASTs and solver states owned by z3
+        SmtContext,
+
+        // constrained data dependency graphs after each basic block
+        DataDependency,
+
+        // call point tables in SummaryEnvironment
+        CallPoint,
+    };
+
+    inline constexpr int kNumMemoryCategory = static_cast<int>(MemoryCategory::CallPoint) + 1;
+
+    // live and peak bytes for each memory category
+    class MemoryUsage
+    {
+    private:
+        // counters are updated from all analysis threads
+        struct Counter
+        {
+            std::atomic<size_t> live{0};
+            std::atomic<size_t> peak{0};
+        };
+
+        std::array<Counter, kNumMemoryCategory> counters_;
+
+    public:
+        size_t Live(MemoryCategory category) const noexcept
+        {
+            return counters_[static_cast<int>(category)].live.load(std::memory_order_relaxed);
+        }
+        size_t Peak(MemoryCategory category) const noexcept
+        {
+            return counters_[static_cast<int>(category)].peak.load(std::memory_order_relaxed);
+        }
+
+        void Allocate(MemoryCategory category, size_t bytes) noexcept
+        {
+            Counter& counter = counters_[static_cast<int>(category)];
+
+            size_t live = counter.live.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+            size_t peak = counter.peak.load(std::memory_order_relaxed);
+            while (live > peak &&
+                   !counter.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        void Release(MemoryCategory category, size_t bytes) noexcept
+        {
+            Counter& counter = counters_[static_cast<int>(category)];
+
+            size_t live = counter.live.load(std::memory_order_relaxed);
+            while (!counter.live.compare_exchange_weak(live, live - std::min(live, bytes),
+                                                       std::memory_order_relaxed))
+            {
+            }
+        }
+
+        // replace an accounted block of `old_bytes` with one of `new_bytes`
+        void Reallocate(MemoryCategory category, size_t old_bytes, size_t new_bytes) noexcept
+        {
+            Release(category, old_bytes);
+            Allocate(category, new_bytes);
+        }
+
+        void Report(std::string_view title) const;
+    };
+
+    // process-wide memory accounting
+    class MemoryAccounting
+    {
+    public:
+        static MemoryUsage& Current() noexcept
+        {
+            static MemoryUsage usage;
+            return usage;
+        }
+
+        static bool Enabled() noexcept { return AnalysisOptions::Current().report_memory; }
+
+        // refresh the live bytes of SmtContext with z3's own allocation counter
+        static void SampleSmtContext();
+    };
+
+    // estimate bytes held by a node-based hash map, excluding what its elements own
+    template <typename K, typename V>
+    size_t EstimateHashMapMemory(const std::unordered_map<K, V>& map) noexcept
+    {
+        // libstdc++ nodes carry a next pointer and a cached hash besides the element
+        constexpr size_t node_size = sizeof(void*) + sizeof(std::pair<const K, V>) + sizeof(size_t);
+
+        return map.bucket_count() * sizeof(void*) + map.size() * node_size;
+    }
+
+    // estimate bytes held by containers, z3 ASTs are accounted by z3 itself
+    inline size_t EstimateMemoryUsage(const PointToMap& pt_map) noexcept
+    {
+        return EstimateHashMapMemory(pt_map);
+    }
+
+    // works for both AbstractStore and hash maps from registers
+    template <typename K>
+    size_t EstimateMemoryUsage(const std::unordered_map<K, PointToMap>& store) noexcept
+    {
+        size_t result = EstimateHashMapMemory(store);
+        for (const auto& [key, pt_map] : store)
+        {
+            result += EstimateMemoryUsage(pt_map);
+        }
+
+        return result;
+    }
+
+    size_t EstimateMemoryUsage(const ConstrainedDataDependencyGraph& graph) noexcept;
+} // namespace mh
@@ -0,0 +1,72 @@
+#pragma once
+#include "controlflow.h"
+#include "llvm/IR/Function.h"
+#include <vector>
+
+namespace mh
+{
+    // A memory SSA form at the granularity of basic blocks, built from sites of abstract execution
+    // that write the abstract store, i.e. DoStore, DoInvoke (and DoAlloc with detailed point-to)
+    //
+    // - MemoryDef: a block that contains any writing site, or the entry block
+    // - MemoryPhi: a block without writing site but merging stores of multiple predecessors
+    // - MemoryUse: otherwise, the store after the block is exactly the store after its only
+    //              predecessor, which is resolved transitively to a MemoryDef/MemoryPhi block
+    //
+    // Blocks of MemoryUse don't need a store of their own, abstract stores only need to be kept and
+    // compared for the owner blocks, i.e. MemoryDef and MemoryPhi blocks
+    class BlockMemorySSA
+    {
+    private:
+        // block -> block that owns the store after it, by block numbers
+        std::vector<int> store_owner_;
+
+    public:
+        BlockMemorySSA(const llvm::Function* func, const FunctionNumbering& numbering);
+
+        /**
+         * Lookup the block that owns the abstract store after execution of a block, by numbers
+         */
+        int LookupStoreOwner(int block) const { return store_owner_[block]; }
+
+        /**
+         * Test if the block is a MemoryUse, i.e. it neither writes nor merges stores
+         */
+        bool IsMemoryUse(int block) const { return LookupStoreOwner(block) != block; }
+
+    private:
+        static bool IsMemoryDefBlock(const llvm::BasicBlock* bb);
+    };
+
+    // Def-use chains between basic blocks, which drive the worklist to re-execute blocks that read
+    // updated states only
+    // - a register is used by blocks with instructions reading its point-to map
+    // - a store is used by blocks initializing their executions from it, i.e. blocks merging it
+    //   from predecessors and MemoryUse blocks loading from it
+    class BlockDefUseIndex
+    {
+    private:
+        using BlockList = std::vector<const llvm::BasicBlock*>;
+
+        // users of registers and of stores owned by blocks, by value and block numbers
+        std::vector<BlockList> reg_users_;
+        std::vector<BlockList> store_users_;
+
+    public:
+        // memory_ssa could be null if every block owns its store
+        BlockDefUseIndex(const FunctionNumbering& numbering, const BlockMemorySSA* memory_ssa);
+
+        // NOTE reg could be kNoNumber, i.e. a global or a constant, which has no user
+        const BlockList& LookupRegisterUsers(int reg) const
+        {
+            static const BlockList empty;
+
+            return reg != FunctionNumbering::kNoNumber ? reg_users_[reg] : empty;
+        }
+
+        const BlockList& LookupStoreUsers(int owner_block) const
+        {
+            return store_users_[owner_block];
+        }
+    };
+} // namespace mh
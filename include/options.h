@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace mh
+{
+    // formats of ResultExporter
+    enum class ExportFormat
+    {
+        // one JSON object per line
+        JsonLines,
+
+        // length-prefixed records of varints
+        Binary,
+    };
+
+    // Runtime knobs of the analysis
+    // values are bound to command line options of the hosting tool, see options.cpp
+    struct AnalysisOptions
+    {
+        // track and report estimated memory consumption of analysis subsystems
+        bool report_memory = false;
+
+        // keep abstract stores only for blocks that define memory, see BlockMemorySSA
+        bool sparse_store = true;
+
+        // number of analyses of a loop head in a stabilization before its updates are widened,
+        // 0 disables widening
+        int widening_delay = 0;
+
+        // budgets of an analysis of a function body, 0 disables a budget
+        // once any is exhausted, all later updates of the analysis are widened so that it
+        // converges in few more visits, see AnalyzeFunctionBlocks
+        int max_block_visits       = 0;
+        int max_function_time_ms   = 0;
+        int64_t max_solver_queries = 0;
+        int max_store_locations    = 0;
+
+        // number of threads analyzing call graph SCCs, 1 keeps the serial analysis and 0 uses
+        // all hardware threads, see ParallelAnalysisDriver
+        int num_threads = 1;
+
+        // directory of summaries persisted across runs, empty disables the cache, see SummaryCache
+        std::string summary_cache_dir;
+
+        // file to stream summaries and RAW dependencies into, empty disables the export, see
+        // ResultExporter
+        std::string export_file;
+
+        ExportFormat export_format = ExportFormat::JsonLines;
+
+        // compute RAW dependencies of converged functions, always on in debug mode, see
+        // DataDependencyAnalysis
+        bool data_dependency = false;
+
+        // release stores of summaries once all their callers converged, see
+        // SummaryEnvironment::NotifyConverged
+        bool evict_summaries = false;
+
+        static AnalysisOptions& Current() noexcept
+        {
+            static AnalysisOptions options;
+            return options;
+        }
+    };
+} // namespace mh
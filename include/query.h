@@ -0,0 +1,83 @@
+#pragma once
+#include "analysis.h"
+#include "datadep.h"
+#include "summary.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace mh
+{
+    // Demand-driven queries of single values, for clients that need facts of one function rather
+    // than summaries of the whole module
+    //
+    // Summaries of called functions are computed on demand, and memoized in the SummaryEnvironment
+    // for later queries. A function is only analyzed over the blocks reaching the queried value,
+    // and its partial analysis is kept and extended by later queries of the same function.
+    //
+    // Results are constraints over aliasing of inputs of the function of the queried value, in the
+    // smt context of the calling thread.
+    // NOTE not thread-safe
+    class QueryEngine
+    {
+    private:
+        struct FunctionState
+        {
+            std::unique_ptr<AnalysisContext> ctx;
+
+            // blocks analyzed so far, closed under predecessors
+            std::unordered_set<const llvm::BasicBlock*> scope;
+
+            // RAW dependencies, computed on the first RawDeps query of the function
+            // NOTE the result store of ctx is built then, see AnalysisContext::BuildResultStore
+            std::optional<DataDependencyResult> data_dep;
+        };
+
+        SummaryEnvironment& env_;
+
+        std::unordered_map<const llvm::Function*, FunctionState> functions_;
+
+    public:
+        QueryEngine(SummaryEnvironment& env);
+        ~QueryEngine();
+
+        QueryEngine(const QueryEngine&)            = delete;
+        QueryEngine& operator=(const QueryEngine&) = delete;
+
+        /**
+         * Locations an argument or instruction may point to. Other values are only defined in a
+         * function using them, and have an empty point-to set.
+         */
+        PointToMap PointsTo(const llvm::Value* val);
+
+        /**
+         * Test if two values may point to the same location. Values in different functions are
+         * not comparable and conservatively may alias.
+         */
+        bool MayAlias(const llvm::Value* a, const llvm::Value* b);
+
+        /**
+         * Values the load may read, i.e. stores, calls, allocations and inputs last writing the
+         * loaded location. The whole function of the load is analyzed.
+         */
+        std::vector<std::pair<const llvm::Value*, Constraint>> RawDeps(const llvm::LoadInst* load);
+
+    private:
+        /**
+         * Analyze blocks of the function reaching any of the targets that are not analyzed yet,
+         * after summaries of functions they call
+         */
+        FunctionState& AnalyzeUpTo(const llvm::Function* func,
+                                   std::vector<const llvm::BasicBlock*> targets);
+
+        /**
+         * Point-to map of a register in the analyzed blocks of a function
+         */
+        PointToMap LookupPointToMap(FunctionState& state, const llvm::Value* val);
+    };
+} // namespace mh
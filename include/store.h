@@ -2,6 +2,7 @@
 #include "constraint.h"
 #include "location.h"
 #include <utility>
+#include <vector>
 
 namespace mh
 {
@@ -96,6 +97,19 @@ namespace mh
     bool EqualPointToMap(ConstraintSolver& solver, const PointToMap& pt_map_old,
                          const PointToMap& pt_map_new);
 
+    // compare if pt_map_1 and pt_map_2 are syntactically identical, i.e. same targets with
+    // identical constraint terms, no solver is involved
+    bool IdenticalPointToMap(const PointToMap& pt_map_1, const PointToMap& pt_map_2);
+
+    // translate constraints in the store into another smt context
+    AbstractStore TranslateStore(const AbstractStore& store, z3::context& ctx);
+
+    // widen pt_map_new against pt_map_old, i.e. its previous value at the same program point
+    // edges with a changed constraint are weakened to an unknown condition, edges only present in
+    // pt_map_old are kept, so that repeated widening converges
+    void WidenPointToMap(ConstraintSolver& solver, const PointToMap& pt_map_old,
+                         PointToMap& pt_map_new);
+
     // assuming all constraints in PointToMap are satisfiable
     // compare if s1 === s2
     // 1. same topology
@@ -107,6 +121,11 @@ namespace mh
     // merge s2 into s1
     void MergeAbstractStore(AbstractStore& s1, const AbstractStore& s2);
 
+    // copy the part of the store reachable from roots by point-to edges, dropping empty point-to
+    // maps, with hash tables sized to the copied entries
+    AbstractStore ExtractReachableStore(const AbstractStore& store,
+                                        const std::vector<AbstractLocation>& roots);
+
     template <typename T> class ConstrainedRelationGraph
     {
     public:
@@ -135,7 +154,7 @@ namespace mh
                 }
                 else
                 {
-                    static Constraint empty{false};
+                    static thread_local Constraint empty{false};
                     return empty;
                 }
             }
@@ -8,6 +8,10 @@
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/InstVisitor.h"
 #include "llvm/Analysis/CFG.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <vector>
 #include <unordered_set>
 
@@ -15,6 +19,60 @@ namespace mh
 {
     class FunctionSummary;
     class SummaryEnvironment;
+    struct FunctionAnalysisInfo;
+    class SummaryCache;
+    class ResultExporter;
+
+    // Dereference chains of inputs in the callee's context, i.e. locations *p, **p, ... of each
+    // input p, up to its pointer nest level
+    // Chains are flattened into a single buffer so that instantiation can walk them without lookup
+    class DerefChainTemplate
+    {
+    private:
+        std::vector<AbstractLocation> locs_;
+
+        // chain of input i is locs_[offsets_[i], offsets_[i + 1])
+        std::vector<int> offsets_ = {0};
+
+    public:
+        int NumInputs() const noexcept { return offsets_.size() - 1; }
+
+        // number of dereference levels of input i, i.e. pointer nest level + 1
+        int ChainLength(int i) const noexcept { return offsets_[i + 1] - offsets_[i]; }
+
+        // location of input i at the given dereference level
+        const AbstractLocation& ChainLocation(int i, int deref_level) const noexcept
+        {
+            return locs_[offsets_[i] + deref_level];
+        }
+
+        void AppendChain(const llvm::Value* input)
+        {
+            int ptr_level = GetPointerNestLevel(input->getType());
+            for (int deref_level = 0; deref_level <= ptr_level; ++deref_level)
+            {
+                locs_.push_back(AbstractLocation::FromRuntimeMemory(input, deref_level));
+            }
+
+            offsets_.push_back(locs_.size());
+        }
+    };
+
+    // accumulated cost of computing a summary
+    struct AnalysisStatistics
+    {
+        // number of analyses of the function body, 0 if the summary is loaded from SummaryCache
+        int num_runs = 0;
+
+        double time_ms = 0;
+
+        // see ConstraintSolver::NumQueries
+        int64_t num_solver_queries = 0;
+
+        // number of analyses that exhausted a budget and fell back to widening all updates, see
+        // AnalysisOptions::max_block_visits
+        int num_degraded_runs = 0;
+    };
 
     class FunctionSummary
     {
@@ -30,6 +88,9 @@ namespace mh
         // globals + parameters
         std::vector<const llvm::Value*> inputs;
 
+        // precomputed dereference chains of `inputs`, for instantiation at call sites
+        DerefChainTemplate deref_chains;
+
         // return instruction of the function
         // NOTE we assume the last instruction of the function is the only exit point
         const llvm::ReturnInst* return_inst;
@@ -39,49 +100,137 @@ namespace mh
         // they are in the same store when written in summary
         AbstractStore store = {};
 
+        // locations in `store` that may represent more than one concrete memory region
+        std::unordered_set<AbstractLocation> summary_locs;
+
+        // number of updates of `store`, for caches to detect a stale summary
+        // NOTE only bumped if the store changes semantically
+        int version = 0;
+
+        // versions of summaries of `called_functions` read by the last analysis of the function,
+        // blocks calling a summary with a different version are re-analyzed by the next one
+        std::vector<int> callee_versions;
+
+        // smt context of constraints in `store`, null for the context of the analyzing thread
+        const z3::context* smt_context = nullptr;
+
         // a summary is converged iff it's computed after all its called function is converged
         bool converged = false;
 
-        // number of caller of this function commited
-        int use_counter = 0;
+        // number of functions calling this function that are not converged yet, the store is
+        // evicted once it drops to 0, see SummaryEnvironment::NotifyConverged
+        int num_pending_callers = 0;
+
+        // if `store` and `summary_locs` are released, as no caller reads them anymore
+        bool evicted = false;
+
+        // NOTE only updated by the thread analyzing the function
+        AnalysisStatistics stats;
     };
 
+    /**
+     * Compact a result store of the function into the form kept in its summary, i.e. locations
+     * reachable from registers and dereference chains of inputs and from the return value, which
+     * are all that instantiation at call sites reads. Internal registers and locations no longer
+     * reachable at the exit point are dropped.
+     */
+    AbstractStore CompactSummaryStore(const FunctionSummary& summary, const AbstractStore& store);
+
     class SummaryEnvironment
     {
     private:
+        // smt context holding stores of published summaries, see PublishSummary
+        // NOTE declared before summaries so that it's destroyed after them
+        std::unique_ptr<z3::context> exchange_context;
+        mutable std::mutex exchange_mutex;
+
         std::unordered_map<const llvm::Function*, std::unique_ptr<FunctionSummary>> analysis_memory;
 
         mutable std::vector<CallPointData> call_point_cache;
         mutable std::unordered_map<std::pair<const llvm::Instruction*, int>, int> call_point_lookup;
+        mutable std::mutex call_point_mutex;
+
+        // if not null, converged summaries are persisted across runs
+        std::unique_ptr<SummaryCache> summary_cache;
+
+        // if not null, converged summaries are exported, owned by the hosting tool
+        ResultExporter* exporter = nullptr;
+
+        // summaries evicted so far, in order, so that threads can drop their translated copies
+        // NOTE guarded by eviction_mutex, except for the size
+        std::vector<const FunctionSummary*> evicted_summaries;
+        std::atomic<size_t> num_evicted = 0;
+        mutable std::mutex eviction_mutex;
+
+        // NOTE infos are never released before the environment, as contexts refer to them
+        mutable std::unordered_map<const llvm::Function*, std::unique_ptr<FunctionAnalysisInfo>>
+            function_infos;
+        mutable std::mutex function_info_mutex;
 
     public:
-        SummaryEnvironment() = default;
+        SummaryEnvironment();
+        ~SummaryEnvironment();
 
+        // NOTE summaries are created on first lookup, so all summaries must be looked up before
+        // being shared between threads
         FunctionSummary& LookupSummary(const llvm::Function* func);
 
+        // lookup a summary to be instantiated in the smt context of the current thread
         const FunctionSummary& LookupSummary(const llvm::Function* func) const;
 
+        // facts of a function shared by all its analyses, computed on first lookup
+        // NOTE the summary of the function must have been looked up
+        const FunctionAnalysisInfo& LookupFunctionInfo(const llvm::Function* func) const;
+
         int ComputeCallPoint(const llvm::Instruction* inst, int prev_call_point) const;
 
-        void NotifyUse(const llvm::Function* func)
-        {
-            // if (func == nullptr || func->isDeclaration())
-            // {
-            //     return;
-            // }
-
-            // if (auto it = analysis_memory.find(func); it != analysis_memory.end())
-            // {
-            //     FunctionSummary& summary = *it->second;
-            //     summary.use_counter += 1;
-            //     if (summary.use_counter >= func->getNumUses())
-            //     {
-            //         analysis_memory.erase(func);
-            //     }
-            // }
-        }
+        // data of an allocated call point, i.e. a positive id returned by ComputeCallPoint
+        CallPointData LookupCallPoint(int call_point) const;
+
+        // collapse a call point, so that no call point is derived from it
+        // used to restore call points recorded by SummaryCache
+        void CollapseCallPoint(int call_point) const;
+
+        // persist converged summaries in a directory, see SummaryCache
+        void EnableSummaryCache(std::string directory);
+
+        SummaryCache* Cache() const noexcept { return summary_cache.get(); }
+
+        // export converged summaries and their RAW dependencies, see ResultExporter
+        void SetExporter(ResultExporter* result_exporter) noexcept { exporter = result_exporter; }
+
+        ResultExporter* Exporter() const noexcept { return exporter; }
+
+        // replace the abstract store of a summary
+        void UpdateSummaryStore(FunctionSummary& summary, AbstractStore store);
+
+        // move the store of a converged summary into the exchange context, so that the summary
+        // can be looked up from other threads
+        void PublishSummary(FunctionSummary& summary);
+
+        // translate a store into the exchange context, to be published with PublishSummaryStore
+        AbstractStore ExportStore(const AbstractStore& store);
+
+        // replace the store of a summary with one translated by ExportStore
+        void PublishSummaryStore(FunctionSummary& summary, AbstractStore exported_store);
+
+        /**
+         * Notify that a summary converged, so that it no longer reads summaries of its called
+         * functions. If summary eviction is enabled, stores of summaries whose callers have all
+         * converged are released, including the summary itself if it has no caller.
+         * NOTE only call once per summary, after every analysis of its function is done
+         */
+        void NotifyConverged(FunctionSummary& summary);
 
     private:
+        // NOTE eviction_mutex must be held
+        void EvictSummary(FunctionSummary& summary);
+
         void InitializeSummary(FunctionSummary& summary, const llvm::Function* func);
+
+        const FunctionSummary& LookupTranslatedSummary(const FunctionSummary& summary) const;
+
+        // NOTE exchange_mutex must be held
+        z3::context& ExchangeContext();
     };
 } // namespace mh
@@ -0,0 +1,111 @@
+#pragma once
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/xxhash.h"
+#include <cstdint>
+#include <string>
+
+namespace mh::detail
+{
+    // little-endian base 128 encoding of integers and length-prefixed strings into a buffer
+    class ByteWriter
+    {
+    private:
+        std::string buffer_;
+
+    public:
+        const std::string& Buffer() const noexcept { return buffer_; }
+
+        void WriteByte(uint8_t x) { buffer_.push_back(static_cast<char>(x)); }
+
+        void WriteVarint(uint64_t x)
+        {
+            while (x >= 0x80)
+            {
+                WriteByte(static_cast<uint8_t>(x) | 0x80);
+                x >>= 7;
+            }
+
+            WriteByte(static_cast<uint8_t>(x));
+        }
+
+        void WriteString(llvm::StringRef s)
+        {
+            WriteVarint(s.size());
+            buffer_.append(s.data(), s.size());
+        }
+
+        void WriteBytes(llvm::StringRef s) { buffer_.append(s.data(), s.size()); }
+
+        uint64_t Hash() const { return llvm::xxHash64(buffer_); }
+    };
+
+    // reader of ByteWriter output, reads past the end or malformed input set `failed`
+    class ByteReader
+    {
+    private:
+        llvm::StringRef data_;
+        size_t pos_  = 0;
+        bool failed_ = false;
+
+    public:
+        ByteReader(llvm::StringRef data) : data_(data) {}
+
+        bool Failed() const noexcept { return failed_; }
+
+        uint8_t ReadByte()
+        {
+            if (pos_ >= data_.size())
+            {
+                failed_ = true;
+                return 0;
+            }
+
+            return static_cast<uint8_t>(data_[pos_++]);
+        }
+
+        uint64_t ReadVarint()
+        {
+            uint64_t result = 0;
+            for (int shift = 0; shift < 64 && !failed_; shift += 7)
+            {
+                uint8_t byte = ReadByte();
+                result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                if ((byte & 0x80) == 0)
+                {
+                    return result;
+                }
+            }
+
+            failed_ = true;
+            return 0;
+        }
+
+        // reads a count of items of at least one byte each, bounded by the remaining input
+        size_t ReadCount()
+        {
+            uint64_t n = ReadVarint();
+            if (n > data_.size() - pos_)
+            {
+                failed_ = true;
+                return 0;
+            }
+
+            return n;
+        }
+
+        llvm::StringRef ReadBytes(size_t n)
+        {
+            if (n > data_.size() - pos_)
+            {
+                failed_ = true;
+                return {};
+            }
+
+            llvm::StringRef result = data_.substr(pos_, n);
+            pos_ += n;
+            return result;
+        }
+
+        llvm::StringRef ReadString() { return ReadBytes(ReadCount()); }
+    };
+} // namespace mh::detail
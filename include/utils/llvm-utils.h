@@ -10,7 +10,7 @@ using ConstOpRange = llvm::User::const_op_range;
 
 inline int GetPointerNestLevel(const llvm::Type* type)
 {
-    static std::unordered_map<const llvm::Type*, int> level_cache;
+    static thread_local std::unordered_map<const llvm::Type*, int> level_cache;
 
     if (auto it = level_cache.find(type); it != level_cache.end())
     {
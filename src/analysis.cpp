@@ -1,26 +1,30 @@
 #include "analysis.h"
+#include "cache.h"
+#include "datadep.h"
+#include "export.h"
 #include "llvm/Analysis/CFG.h"
+#include <atomic>
 #include <deque>
+#include <numeric>
+#include <optional>
 #include <unordered_set>
 
 using namespace std;
 using namespace llvm;
 
-extern int GLOBAL_NUM_RAW_STORE;
-extern int GLOBAL_NUM_RAW_CALL;
-extern int GLOBAL_NUM_RAW_ARG;
+std::atomic<int> GLOBAL_NUM_RAW_STORE = 0;
+std::atomic<int> GLOBAL_NUM_RAW_CALL  = 0;
+std::atomic<int> GLOBAL_NUM_RAW_ARG   = 0;
 
 namespace mh
 {
-    AnalysisContext::AnalysisContext(const SummaryEnvironment* env, const FunctionSummary* summary)
-        : smt_solver_(summary->inputs.size()), ctrl_flow_info_(summary->func)
+    FunctionAnalysisInfo::FunctionAnalysisInfo(const FunctionSummary& summary)
+        : numbering(summary.func), ctrl_flow_info(summary.func, numbering),
+          memory_ssa(summary.func, numbering),
+          def_use(numbering, AnalysisOptions::Current().sparse_store ? &memory_ssa : nullptr)
     {
-        this->env_             = env;
-        this->current_summary_ = summary;
-
         // add alias rejection
-        const vector<const Value*>& inputs = summary->inputs;
-        vector<int> ptr_nest_levels;
+        const vector<const Value*>& inputs = summary.inputs;
         for (const Value* arg : inputs)
         {
             ptr_nest_levels.push_back(GetPointerNestLevel(arg->getType()));
@@ -37,7 +41,7 @@ namespace mh
 
                 if (!type_i->isPointerTy() || !type_j->isPointerTy())
                 {
-                    smt_solver_.RejectAlias(i, j);
+                    rejected_aliases.push_back(pair{i, j});
 
 #ifdef HEAP_ANALYSIS_DEBUG_MODE
                     // fmt::print("[analysis] rejecting alias({}, {}), reason: non-ptr type\n", i,
@@ -49,7 +53,7 @@ namespace mh
                     // TODO: exclude opaque pointer, i.e. void*
                     // TODO: add toggles for relaxed aliasing rules
                     // TODO: reject non-interfering alias, e.g. two pointers that are not written
-                    smt_solver_.RejectAlias(i, j);
+                    rejected_aliases.push_back(pair{i, j});
 
 #ifdef HEAP_ANALYSIS_DEBUG_MODE
                     // fmt::print("[analysis] rejecting alias({}, {}), reason: different ptr
@@ -59,7 +63,7 @@ namespace mh
                 }
                 else if (isa<GlobalVariable>(arg_i) && isa<GlobalVariable>(arg_j))
                 {
-                    smt_solver_.RejectAlias(i, j);
+                    rejected_aliases.push_back(pair{i, j});
 
 #ifdef HEAP_ANALYSIS_DEBUG_MODE
                     // fmt::print(
@@ -70,7 +74,7 @@ namespace mh
                 else if (type_i != type_j)
                 {
                     // TODO: this is unsound!!!!!!
-                    smt_solver_.RejectAlias(i, j);
+                    rejected_aliases.push_back(pair{i, j});
 #ifdef HEAP_ANALYSIS_DEBUG_MODE
 // fmt::print("[analysis] rejecting alias({}, {}), reason:
 //                     different type\n ", i,
@@ -79,6 +83,37 @@ namespace mh
                 }
             }
         }
+    }
+
+    size_t EstimateMemoryUsage(const AbstractRegFile& regfile) noexcept
+    {
+        size_t result = EstimateMemoryUsage(regfile.other_regs_) +
+                        regfile.local_regs_.capacity() * sizeof(PointToMap);
+        for (const PointToMap& pt_map : regfile.local_regs_)
+        {
+            result += EstimateMemoryUsage(pt_map);
+        }
+
+        return result;
+    }
+
+    AnalysisContext::AnalysisContext(const SummaryEnvironment* env, const FunctionSummary* summary)
+        : info_(env->LookupFunctionInfo(summary->func)), smt_solver_(summary->inputs.size()),
+          regfile_(info_.numbering), exec_store_cache_(info_.numbering.NumBlocks()),
+          block_loaded_locs_(info_.numbering.NumBlocks()),
+          pending_pass_locs_(info_.numbering.NumBlocks()),
+          alias_map_(info_.numbering.NumValues())
+    {
+        this->env_             = env;
+        this->current_summary_ = summary;
+
+        for (const auto& [i, j] : info_.rejected_aliases)
+        {
+            smt_solver_.RejectAlias(i, j);
+        }
+
+        const vector<const Value*>& inputs = summary->inputs;
+        const vector<int>& ptr_nest_levels = info_.ptr_nest_levels;
 
         // initialize entry store for analysis
         for (int i = 0; i < inputs.size(); ++i)
@@ -127,9 +162,29 @@ namespace mh
         }
     }
 
+    AnalysisContext::~AnalysisContext()
+    {
+        // memory owned by this context is released
+        for (auto category :
+             {MemoryCategory::ExecStore, MemoryCategory::RegFile, MemoryCategory::DataDependency})
+        {
+            MemoryAccounting::Current().Release(category, memory_usage_.Live(category));
+        }
+    }
+
     std::unique_ptr<AbstractExecution>
     AnalysisContext::InitializeExecution(const llvm::BasicBlock* bb)
     {
+        // a MemoryUse block reads the store of its owner in place
+        int block = Numbering().BlockNumber(bb);
+        if (int owner = LookupStoreOwner(block); owner != block)
+        {
+            const AbstractStore* store =
+                exec_store_cache_[owner] ? &*exec_store_cache_[owner] : &this->entry_store_;
+
+            return std::make_unique<AbstractExecution>(this, store);
+        }
+
         AbstractStore bb_init_store;
         auto merge_store = [&](const AbstractStore& store) {
             if (bb_init_store.empty())
@@ -145,10 +200,11 @@ namespace mh
         // merge
         for (const BasicBlock* pred_bb : predecessors(bb))
         {
-            bool loopback = ctrl_flow_info_.IsBackEdge(pred_bb, bb);
-            if (auto it = exec_store_cache_.find(pred_bb); it != exec_store_cache_.end())
+            int pred      = Numbering().BlockNumber(pred_bb);
+            bool loopback = info_.ctrl_flow_info.IsBackEdge(pred, block);
+            if (const auto& pred_store = exec_store_cache_[LookupStoreOwner(pred)]; pred_store)
             {
-                merge_store(it->second);
+                merge_store(*pred_store);
             }
             else if (!loopback)
             {
@@ -171,55 +227,164 @@ namespace mh
     bool AnalysisContext::CommitExecution(const llvm::BasicBlock* bb,
                                           std::unique_ptr<AbstractExecution> exec)
     {
-        // find iterator to the old store
-        auto it = exec_store_cache_.find(bb);
+        if (MemoryAccounting::Enabled())
+        {
+            AccountMemory(MemoryCategory::RegFile, memory_usage_.Live(MemoryCategory::RegFile),
+                          EstimateMemoryUsage(regfile_));
+        }
 
-        // first run, always update
-        if (it == exec_store_cache_.end())
+        for (const Value* reg : exec->updated_regs_)
         {
-            exec_store_cache_[bb] = move(exec->store_);
-            return true;
+            MarkAffectedBlocks(info_.def_use.LookupRegisterUsers(Numbering().ValueNumber(reg)));
         }
 
-        // consequent run, update if execution state is changed
-        if (exec->TestStoreUpdate(it->second))
+        // MemoryUse block, updated if any register is updated, changes of the owner's store are
+        // propagated when committing the owner
+        int block = Numbering().BlockNumber(bb);
+        if (exec->shared_store_ != nullptr)
         {
-            it->second = move(exec->store_);
-            return true;
+            optional<vector<AbstractLocation>>& loaded_locs = block_loaded_locs_[block];
+            bool first_run                                  = !loaded_locs;
+
+            loaded_locs = move(exec->loaded_locs_);
+            return first_run || !exec->updated_regs_.empty();
+        }
+
+        // the old store
+        optional<AbstractStore>& old_store = exec_store_cache_[block];
+
+        if (MemoryAccounting::Enabled())
+        {
+            size_t old_bytes = old_store ? EstimateMemoryUsage(*old_store) : 0;
+            AccountMemory(MemoryCategory::ExecStore, old_bytes, EstimateMemoryUsage(exec->store_));
+        }
+
+        vector<AbstractLocation> updated_locs;
+        bool first_run = !old_store;
+        if (first_run)
+        {
+            // first run, every location is updated
+            for (const auto& [loc, pt_map] : exec->store_)
+            {
+                updated_locs.push_back(loc);
+            }
+
+            old_store = move(exec->store_);
         }
+        else
+        {
+            // consequent run, update if execution state is changed
+            unordered_set<AbstractLocation> pass_locs = exchange(pending_pass_locs_[block], {});
+
+            updated_locs = exec->CollectUpdatedLocations(*old_store, pass_locs);
+
+            if (exec->widen_)
+            {
+                // drop locations that are stable after widening
+                auto is_stable = [&](const AbstractLocation& loc) {
+                    static const PointToMap empty_pt_map;
+
+                    auto it_old                  = old_store->find(loc);
+                    const PointToMap& pt_map_old =
+                        it_old != old_store->end() ? it_old->second : empty_pt_map;
+                    PointToMap& pt_map_new = exec->store_[loc];
 
-        // TODO: workaround, still update store as it's equivalent anyway
-        it->second = move(exec->store_);
+                    WidenPointToMap(Solver(), pt_map_old, pt_map_new);
+                    return IdenticalPointToMap(pt_map_new, pt_map_old);
+                };
+
+                updated_locs.erase(remove_if(updated_locs.begin(), updated_locs.end(), is_stable),
+                                   updated_locs.end());
+            }
+
+            // TODO: workaround, still update store as it's equivalent anyway
+            *old_store = move(exec->store_);
+        }
+
+        if (updated_locs.empty())
+        {
+            return first_run || !exec->updated_regs_.empty();
+        }
+
+        for (const BasicBlock* user_bb : info_.def_use.LookupStoreUsers(block))
+        {
+            // MemoryUse blocks that have run only need to be re-executed if they load any of the
+            // updated locations
+            int user = Numbering().BlockNumber(user_bb);
+            if (const optional<vector<AbstractLocation>>& loaded_locs = block_loaded_locs_[user];
+                loaded_locs)
+            {
+                if (none_of(loaded_locs->begin(), loaded_locs->end(), [&](const auto& loc) {
+                        return find(updated_locs.begin(), updated_locs.end(), loc) !=
+                               updated_locs.end();
+                    }))
+                {
+                    continue;
+                }
+            }
+            else if (exec_store_cache_[user])
+            {
+                pending_pass_locs_[user].insert(updated_locs.begin(), updated_locs.end());
+            }
+
+            affected_blocks_.push_back(user_bb);
+        }
 
-        // no update
-        return false;
+        return true;
     }
 
-    void AnalysisContext::BuildResultStore()
+    void AnalysisContext::BuildResultStore(bool keep_state)
     {
-        AbstractStore result = std::move(exec_store_cache_.at(&current_summary_->func->back()));
-        for (auto& [reg, pt_map] : regfile_)
+        int exit_block            = Numbering().BlockNumber(&current_summary_->func->back());
+        AbstractStore& exit_store = exec_store_cache_[LookupStoreOwner(exit_block)].value();
+        if (keep_state)
         {
-            result[AbstractLocation::FromRegister(reg)] = std::move(pt_map);
+            AbstractStore result = exit_store;
+            regfile_.ForEach([&](const Value* reg, const PointToMap& pt_map) {
+                result[AbstractLocation::FromRegister(reg)] = pt_map;
+            });
+
+            NormalizeStore(smt_solver_, result);
+            result_store_ = move(result);
+            return;
         }
 
+        AbstractStore result = std::move(exit_store);
+        regfile_.ForEach([&](const Value* reg, PointToMap& pt_map) {
+            result[AbstractLocation::FromRegister(reg)] = std::move(pt_map);
+        });
+
         NormalizeStore(smt_solver_, result);
         result_store_ = move(result);
     }
 
     void AnalysisContext::ExportRAWDependency()
     {
-        // collect store and load instructions in the function
-        vector<const StoreInst*> stores;
+        // a store written into its pointer's targets, with the constraint of each target
+        struct IndexedStore
+        {
+            const StoreInst* inst;
+            Constraint c_ptr;
+        };
+
+        // index stores by the locations they may write, in weak topological order of blocks, so
+        // that a load only visits stores of the locations it reads
+        unordered_map<AbstractLocation, vector<IndexedStore>> store_index;
         vector<const LoadInst*> loads;
 
-        for (const BasicBlock& bb : *current_summary_->func)
+        const WeakTopologicalOrder& wto = info_.ctrl_flow_info.Wto();
+        for (int i = 0; i < wto.Size(); ++i)
         {
-            for (const Instruction& inst : bb)
+            for (const Instruction& inst : *wto.At(i))
             {
                 if (auto store_inst = dyn_cast<StoreInst>(&inst))
                 {
-                    stores.push_back(store_inst);
+                    const PointToMap& store_ptr_pt_map =
+                        regfile_.Lookup(TranslateAliasReg(store_inst->getPointerOperand()));
+                    for (const auto& [loc_store_ptr, c_store_ptr] : store_ptr_pt_map)
+                    {
+                        store_index[loc_store_ptr].push_back({store_inst, c_store_ptr});
+                    }
                 }
                 else if (auto load_inst = dyn_cast<LoadInst>(&inst))
                 {
@@ -228,21 +393,47 @@ namespace mh
             }
         }
 
+        // (location, i, j) -> if store i of the location is always overwritten by store j
+        // NOTE independent of the load, so solver queries are shared by all loads of a location
+        unordered_map<pair<const AbstractLocation*, pair<int, int>>, bool> overwrite_cache;
+        auto is_overwritten = [&](const AbstractLocation& loc, const vector<IndexedStore>& stores,
+                                  int i, int j) {
+            auto [it, inserted] = overwrite_cache.try_emplace(pair{&loc, pair{i, j}}, false);
+            if (inserted)
+            {
+                const FunctionControlFlowInfo& ctrl_flow_info = info_.ctrl_flow_info;
+                it->second =
+                    ctrl_flow_info.LookupExecAfterCondition(stores[i].inst, stores[j].inst) ==
+                        ExecAfterCondition::Must &&
+                    smt_solver_.TestImplication(stores[j].c_ptr, stores[i].c_ptr);
+            }
+
+            return it->second;
+        };
+
         // compute pdge edges with constraints
         map<pair<const LoadInst*, const StoreInst*>, Constraint> pdg_edges;
+        vector<int> dependencies;
         for (const LoadInst* load_inst : loads)
         {
             const PointToMap& load_ptr_pt_map =
-                regfile_.at(TranslateAliasReg(load_inst->getPointerOperand()));
+                regfile_.Lookup(TranslateAliasReg(load_inst->getPointerOperand()));
 
             for (const auto& [loc_load_ptr, c_load_ptr] : load_ptr_pt_map)
             {
-                // lookup dependencies for the particular ptr location
-                unordered_map<const StoreInst*, Constraint> dependencies;
+                auto it_index = store_index.find(loc_load_ptr);
+                if (it_index == store_index.end())
+                {
+                    continue;
+                }
+
+                const auto& [loc, stores] = *it_index;
 
-                for (const StoreInst* store_inst : stores)
+                // lookup dependencies for the particular ptr location, as indices into `stores`
+                dependencies.clear();
+                for (int i = 0; i < static_cast<int>(stores.size()); ++i)
                 {
-                    if (ctrl_flow_info_.LookupExecAfterCondition(store_inst, load_inst) ==
+                    if (info_.ctrl_flow_info.LookupExecAfterCondition(stores[i].inst, load_inst) ==
                         ExecAfterCondition::Never)
                     {
                         // load instruction never executes after this store instruction
@@ -250,61 +441,38 @@ namespace mh
                         continue;
                     }
 
-                    const PointToMap& store_ptr_pt_map =
-                        regfile_.at(TranslateAliasReg(store_inst->getPointerOperand()));
-
-                    if (auto it_store_ptr = store_ptr_pt_map.find(loc_load_ptr);
-                        it_store_ptr != store_ptr_pt_map.end())
+                    // indicate if this store would be overwritten by a following store
+                    bool store_overwritten = false;
+                    for (auto it_dep = dependencies.begin(); it_dep != dependencies.end();)
                     {
-                        const auto& [loc_store_ptr, c_store_ptr] = *it_store_ptr;
-
-                        // pointer doesn't alias
-                        if (loc_load_ptr != loc_store_ptr &&
-                            !smt_solver_.TestSatisfiability(c_load_ptr && c_store_ptr))
+                        if (is_overwritten(loc, stores, *it_dep, i))
                         {
+                            // this store instruction overwrite dep_store
+                            it_dep = dependencies.erase(it_dep);
                             continue;
                         }
 
-                        // indicate if this store would be overwritten by a following store
-                        bool store_overwritten = false;
-                        for (auto it_dep_store = dependencies.begin();
-                             it_dep_store != dependencies.end();)
+                        if (is_overwritten(loc, stores, i, *it_dep))
                         {
-                            const auto& [dep_store_inst, c_dep_store_ptr] = *it_dep_store;
-
-                            if (ctrl_flow_info_.LookupExecAfterCondition(
-                                    dep_store_inst, store_inst) == ExecAfterCondition::Must &&
-                                smt_solver_.TestImplication(c_store_ptr, c_dep_store_ptr))
-                            {
-                                // this store instruction overwrite dep_store
-                                it_dep_store = dependencies.erase(it_dep_store);
-                                continue;
-                            }
-
-                            if (ctrl_flow_info_.LookupExecAfterCondition(
-                                    store_inst, dep_store_inst) == ExecAfterCondition::Must &&
-                                smt_solver_.TestImplication(c_dep_store_ptr, c_store_ptr))
-                            {
-                                // this store instruction is overwritten by dep_store
-                                store_overwritten = true;
-                                break;
-                            }
-
-                            ++it_dep_store;
+                            // this store instruction is overwritten by dep_store
+                            store_overwritten = true;
+                            break;
                         }
 
-                        if (!store_overwritten)
-                        {
-                            dependencies.insert_or_assign(store_inst, c_store_ptr);
-                        }
+                        ++it_dep;
+                    }
+
+                    if (!store_overwritten)
+                    {
+                        dependencies.push_back(i);
                     }
                 }
 
-                for (const auto& [store_inst, c_store_ptr] : dependencies)
+                for (int i : dependencies)
                 {
-                    Constraint& constraint = pdg_edges[pair{load_inst, store_inst}];
+                    Constraint& constraint = pdg_edges[pair{load_inst, stores[i].inst}];
 
-                    constraint = constraint || (c_load_ptr && c_store_ptr);
+                    constraint = constraint || (c_load_ptr && stores[i].c_ptr);
                 }
             }
         }
@@ -357,7 +525,7 @@ namespace mh
         auto lookup_store = [&](AbstractLocation loc) -> const PointToMap& {
             if (loc.Tag() == LocationTag::Register && regfile != nullptr)
             {
-                return regfile->at(loc.Definition());
+                return regfile->Lookup(loc.Definition());
             }
             else if (auto it = store.find(loc); it != store.end())
             {
@@ -447,13 +615,16 @@ namespace mh
         // to print registers in this block
         for (const Instruction& inst : *bb)
         {
-            if (regfile_.find(&inst) != regfile_.end())
+            if (!regfile_.Lookup(&inst).empty())
             {
                 root_locs.push_back(AbstractLocation::FromRegister(&inst));
             }
         }
 
-        const AbstractStore& store = bb != nullptr ? exec_store_cache_.at(bb) : entry_store_;
+        const AbstractStore& store =
+            bb != nullptr
+                ? exec_store_cache_[LookupStoreOwner(Numbering().BlockNumber(bb))].value()
+                : entry_store_;
         PrintStore(store, root_locs, &regfile_, &current_summary_->inputs);
     }
 
@@ -491,139 +662,17 @@ namespace mh
         PrintStore(summary.store, root_locs, nullptr, &summary.inputs);
     }
 
-    bool AnalysisContext::AnalyzeBlock_DataDep(const llvm::BasicBlock* bb)
-    {
-        int pred_index = 0;
-        ConstrainedDataDependencyGraph graph;
-        for (const BasicBlock* prev_bb : predecessors(bb))
-        {
-            if (pred_index == 0)
-            {
-                graph = data_dep_cache_[prev_bb];
-            }
-            else
-            {
-                graph.Merge(Solver(), data_dep_cache_[prev_bb]);
-            }
-
-            pred_index += 1;
-        }
-
-        // initialize if no predecessor, i.e. first basic block
-        if (pred_index == 0)
-        {
-            for (int i = 0; i < current_summary_->inputs.size(); ++i)
-            {
-                const Value* arg_i = current_summary_->inputs[i];
-                int ptr_level_i    = GetPointerNestLevel(arg_i->getType());
-
-                for (int k = 0; k < ptr_level_i; ++k)
-                {
-                    graph[AbstractLocation::FromRuntimeMemory(arg_i, k)][arg_i] = Constraint{true};
-                }
-            }
-        }
-
-        for (const Instruction& inst : *bb)
-        {
-            if (isa<AllocaInst>(inst) || IsMallocCall(&inst))
-            {
-                auto loc_alloc          = AbstractLocation::FromAllocation(&inst);
-                graph[loc_alloc][&inst] = Constraint{true};
-            }
-            else if (auto store_inst = dyn_cast<StoreInst>(&inst))
-            {
-                const PointToMap& ptr_locs = result_store_[AbstractLocation::FromRegister(
-                    TranslateAliasReg(store_inst->getPointerOperand()))];
-
-                for (const auto& [ptr, c_ptr] : ptr_locs)
-                {
-                    graph.OverwriteRelationEdge(ptr, store_inst, c_ptr);
-                }
-            }
-            else if (auto load_inst = dyn_cast<LoadInst>(&inst))
-            {
-                // find data flow
-                const PointToMap& ptr_locs = result_store_[AbstractLocation::FromRegister(
-                    TranslateAliasReg(load_inst->getPointerOperand()))];
-
-                for (const auto& [ptr, c_ptr] : ptr_locs)
-                {
-                    for (const auto [src_val, c_contrib] : graph[ptr])
-                    {
-                        Constraint c_dep = c_ptr && c_contrib;
-
-                        if (Solver().TestSatisfiability(c_dep))
-                        {
-                            data_dep_result_[pair{load_inst, src_val}] = c_dep;
-                        }
-                    }
-                }
-            }
-            else if (auto call_inst = dyn_cast<CallInst>(&inst))
-            {
-                if (auto it = update_hitory_.find(call_inst); it != update_hitory_.end())
-                {
-                    const PointToMap& ptr_locs = it->second;
-
-                    for (const auto& [ptr, c_passin] : ptr_locs)
-                    {
-                        graph.OverwriteRelationEdge(ptr, call_inst, c_passin.Weaken());
-                    }
-                }
-            }
-        }
-
-        auto& graph_cell = data_dep_cache_[bb];
-
-        // TODO: workaround, verify soundness of such trick
-        graph.UpdateCachedNumEdge();
-        // bool updated = graph.CachedNumEdge() != graph_cell.CachedNumEdge();
-        bool updated = graph.CachedNumEdge() != graph_cell.CachedNumEdge() ||
-                       !graph.Equals(Solver(), graph_cell);
-
-        graph_cell = move(graph);
-        return updated;
-    }
-
-    void AnalyzeFunction_DataDep(AnalysisContext& ctx)
-    {
-        deque<const BasicBlock*> worklist;
-        unordered_set<const BasicBlock*> workset;
-
-        for (const BasicBlock& bb : *ctx.Func())
-        {
-            worklist.push_back(&bb);
-            workset.insert(&bb);
-        }
-
-        while (!worklist.empty())
-        {
-            const BasicBlock* bb = worklist.front();
-            worklist.pop_front();
-            workset.erase(bb);
-
-            if (ctx.AnalyzeBlock_DataDep(bb))
-            {
-                for (const BasicBlock* succ_bb : successors(bb))
-                {
-                    if (workset.find(succ_bb) == workset.end())
-                    {
-                        worklist.push_back(succ_bb);
-                        workset.insert(succ_bb);
-                    }
-                }
-            }
-        }
-    }
-
-    bool AnalysisContext::AnalyzeBlock(const llvm::BasicBlock* bb)
+    bool AnalysisContext::AnalyzeBlock(const llvm::BasicBlock* bb, bool widen)
     {
 #ifdef HEAP_ANALYSIS_DEBUG_MODE
         // fmt::print("analyzing block {}...\n", bb->getName());
 #endif
 
         auto exec = InitializeExecution(bb);
+        if (widen)
+        {
+            exec->EnableWidening();
+        }
 
         for (const Instruction& inst : *bb)
         {
@@ -711,57 +760,279 @@ namespace mh
         return CommitExecution(bb, move(exec));
     }
 
+    // test if the analysis in ctx exceeded any budget of AnalysisOptions, after bb is analyzed
+    static bool ExhaustedBudget(AnalysisContext& ctx, const BasicBlock* bb, int num_block_visits,
+                                int64_t num_solver_queries,
+                                chrono::steady_clock::time_point t_start)
+    {
+        const AnalysisOptions& options = AnalysisOptions::Current();
+        if (options.max_block_visits > 0 && num_block_visits > options.max_block_visits)
+        {
+            return true;
+        }
+
+        if (options.max_solver_queries > 0 && num_solver_queries > options.max_solver_queries)
+        {
+            return true;
+        }
+
+        if (options.max_store_locations > 0 &&
+            ctx.NumStoreLocations(bb) > options.max_store_locations)
+        {
+            return true;
+        }
+
+        return options.max_function_time_ms > 0 &&
+               chrono::steady_clock::now() - t_start >
+                   chrono::milliseconds{options.max_function_time_ms};
+    }
+
+    void AnalyzeFunctionBlocks(AnalysisContext& ctx, unordered_set<const BasicBlock*> dirty,
+                               const unordered_set<const BasicBlock*>* scope)
+    {
+        const WeakTopologicalOrder& wto = ctx.ControlFlowInfo().Wto();
+        int widening_delay              = AnalysisOptions::Current().widening_delay;
+
+        auto t_start               = chrono::steady_clock::now();
+        int64_t num_queries_before = ctx.Solver().NumQueries();
+        int num_block_visits       = 0;
+        wto.Iterate(dirty, [&](const BasicBlock* bb, int num_visit) {
+            // once degraded, an edge is weakened when its constraint changes and never changes
+            // again, so the fixpoint is reached soon after
+            bool widen = ctx.Degraded() ||
+                         (widening_delay > 0 && wto.IsLoopHead(bb) && num_visit > widening_delay);
+
+            // only blocks reading updated registers or stores are re-executed
+            ctx.AnalyzeBlock(bb, widen);
+            for (const BasicBlock* affected_bb : ctx.TakeAffectedBlocks())
+            {
+                if (scope == nullptr || scope->count(affected_bb) > 0)
+                {
+                    dirty.insert(affected_bb);
+                }
+            }
+
+            num_block_visits += 1;
+            if (!ctx.Degraded() &&
+                ExhaustedBudget(ctx, bb, num_block_visits,
+                                ctx.Solver().NumQueries() - num_queries_before, t_start))
+            {
+#ifdef HEAP_ANALYSIS_DEBUG_MODE
+                fmt::print("budget exhausted in function {}, widening all updates\n",
+                           ctx.Func()->getName());
+#endif
+                ctx.Degrade();
+            }
+        });
+    }
+
     // analyze the function once, assuming summaries of all called functions ready
-    void AnalyzeFunctionAux(SummaryEnvironment& env, FunctionSummary& summary,
-                            bool dependencies_converged = false)
+    // run the intraprocedural fixpoint of the function in ctx and build its result store
+    void AnalyzeFunctionBody(AnalysisContext& ctx, bool keep_state = false)
     {
-        if (summary.converged)
+        const Function* func = ctx.Func();
+        unordered_set<const BasicBlock*> dirty;
+        for (const BasicBlock& bb : *func)
         {
-            return;
+            dirty.insert(&bb);
+        }
+
+        AnalyzeFunctionBlocks(ctx, move(dirty));
+
+        // TODO: what solver to use?
+        // TODO: verify reassignment is correct
+        ctx.BuildResultStore(keep_state);
+    }
+
+    // analysis contexts of recursive functions that are not converged yet, kept across analyses
+    // in AnalyzeFunctionRecursive as warm starts
+    using WarmStartContexts = unordered_map<const Function*, unique_ptr<AnalysisContext>>;
+
+} thread_local double mh::g_check_ms = 0; thread_local double mh::g_fresh_ms = 0; namespace mh {
+    // versions of summaries of called functions, in the order of FunctionSummary::called_functions
+    vector<int> LookupCalleeVersions(SummaryEnvironment& env, const FunctionSummary& summary)
+    {
+        vector<int> versions;
+        versions.reserve(summary.called_functions.size());
+        for (const Function* callee : summary.called_functions)
+        {
+            // TODO: workaround, why nullptr?
+            versions.push_back(callee != nullptr ? env.LookupSummary(callee).version : 0);
         }
 
+        return versions;
+    }
+
+    // re-run the fixpoint of a function analyzed in ctx from blocks calling functions whose
+    // summaries are updated since versions_before, and rebuild its result store
+    void ReanalyzeFunctionBody(AnalysisContext& ctx, const vector<int>& versions_before,
+                               const vector<int>& versions)
+    {
+        const vector<const Function*>& callees = ctx.CurrentSummary()->called_functions;
+        unordered_set<const Function*> updated_callees;
+        for (int i = 0; i < callees.size(); ++i)
+        {
+            if (versions[i] != versions_before[i])
+            {
+                updated_callees.insert(callees[i]);
+            }
+        }
+
+        unordered_set<const BasicBlock*> dirty;
+        for (const BasicBlock& bb : *ctx.Func())
+        {
+            for (const Instruction& inst : bb)
+            {
+                auto call_inst = dyn_cast<CallInst>(&inst);
+                if (call_inst != nullptr && updated_callees.count(call_inst->getCalledFunction()) > 0)
+                {
+                    dirty.insert(&bb);
+                    break;
+                }
+            }
+        }
+
+        AnalyzeFunctionBlocks(ctx, move(dirty));
+        ctx.BuildResultStore(true);
+    }
+
+    // add data dependency counts of a function to the totals, and print them in debug mode
+    void AccumulateDataDependencyCounts(const DataDependencyCounts& counts,
+                                        chrono::high_resolution_clock::time_point t_start)
+    {
+        GLOBAL_NUM_RAW_STORE += counts.num_raw_store;
+        GLOBAL_NUM_RAW_CALL += counts.num_raw_call;
+        GLOBAL_NUM_RAW_ARG += counts.num_raw_arg;
+
 #ifdef HEAP_ANALYSIS_DEBUG_MODE
-        fmt::print("---------\n");
-        fmt::print("processing function {}\n", summary.func->getName());
+        using FpMilliseconds = std::chrono::duration<float, std::chrono::milliseconds::period>;
+        auto t_stop          = chrono::high_resolution_clock::now();
+
+        fmt::print("Run Time = {} ms check {} ms fresh {}\n", FpMilliseconds(t_stop - t_start).count(), g_check_ms, g_fresh_ms); g_fresh_ms = 0; g_check_ms = 0;
 
-        auto t_start = chrono::high_resolution_clock::now();
+        fmt::print("Num RAW (load-store) = {}\n", counts.num_raw_store);
+        fmt::print("Num RAW (load-call) = {}\n", counts.num_raw_call);
+        fmt::print("Num RAW (load-arg) = {}\n", counts.num_raw_arg);
+        fmt::print("Total RAW (load-store) = {}\n", GLOBAL_NUM_RAW_STORE.load());
+        fmt::print("Total RAW (load-call) = {}\n", GLOBAL_NUM_RAW_CALL.load());
+        fmt::print("Total RAW (load-arg) = {}\n", GLOBAL_NUM_RAW_ARG.load());
 #endif
-        AnalysisContext ctx{&env, &summary};
+    }
 
-        const Function* func = summary.func;
-        deque<const BasicBlock*> worklist;
-        unordered_set<const BasicBlock*> workset;
+    // compute, count and export data dependencies of a function with converged summary
+    // NOTE BuildResultStore must have been called on ctx
+    DataDependencyCounts ReportDataDependency(AnalysisContext& ctx,
+                                              chrono::high_resolution_clock::time_point t_start)
+    {
+        DataDependencyAnalysis data_dep{ctx};
+        const DataDependencyResult& result = data_dep.Run();
 
-        for (const BasicBlock& bb : *func)
+        DataDependencyCounts counts = result.Count();
+        AccumulateDataDependencyCounts(counts, t_start);
+
+        if (ResultExporter* exporter = ctx.Environment()->Exporter())
         {
-            worklist.push_back(&bb);
-            workset.insert(&bb);
+            exporter->ExportDataDependencies(ctx.Func(), result.edges);
         }
 
-        while (!worklist.empty())
+        return counts;
+    }
+
+    // add the cost of an analysis since t_start to the statistics of a summary
+    void RecordAnalysisCost(AnalysisStatistics& stats,
+                            chrono::high_resolution_clock::time_point t_start, int num_runs,
+                            int64_t num_solver_queries, bool degraded = false)
+    {
+        using FpMilliseconds = std::chrono::duration<double, std::chrono::milliseconds::period>;
+
+        stats.num_runs += num_runs;
+        stats.time_ms += FpMilliseconds(chrono::high_resolution_clock::now() - t_start).count();
+        stats.num_solver_queries += num_solver_queries;
+        stats.num_degraded_runs += degraded;
+    }
+
+    // if warm_contexts is not null, the analysis is kept there until the function converges, and
+    // the next analysis only re-analyzes blocks calling updated summaries
+    void AnalyzeFunctionAux(SummaryEnvironment& env, FunctionSummary& summary,
+                            bool dependencies_converged      = false,
+                            WarmStartContexts* warm_contexts = nullptr)
+    {
+        if (summary.converged)
         {
-            const BasicBlock* bb = worklist.front();
-            worklist.pop_front();
-            workset.erase(bb);
+            return;
+        }
+
+        auto t_analysis = chrono::high_resolution_clock::now();
+
+#ifdef HEAP_ANALYSIS_DEBUG_MODE
+        fmt::print("---------\n");
+        fmt::print("processing function {}\n", summary.func->getName());
+#endif
 
-            if (ctx.AnalyzeBlock(bb))
+        // summaries of recursive functions depend on themselves, thus are not cached
+        SummaryCache* cache = summary.func->doesNotRecurse() ? env.Cache() : nullptr;
+        if (cache != nullptr)
+        {
+            if (optional<CachedSummary> cached = cache->Load(env, summary))
             {
-                for (const BasicBlock* succ_bb : successors(bb))
+                if (DataDependencyEnabled())
                 {
-                    if (workset.find(succ_bb) == workset.end())
-                    {
-                        worklist.push_back(succ_bb);
-                        workset.insert(succ_bb);
-                    }
+                    AccumulateDataDependencyCounts(cached->counts, t_analysis);
+                }
+
+                env.UpdateSummaryStore(summary, move(cached->store));
+                summary.summary_locs = move(cached->summary_locs);
+                summary.converged    = true;
+
+                if (ResultExporter* exporter = env.Exporter())
+                {
+                    exporter->ExportSummary(env, summary);
                 }
+
+                RecordAnalysisCost(summary.stats, t_analysis, 0, 0);
+                env.NotifyConverged(summary);
+                return;
             }
         }
 
-        // TODO: what solver to use?
-        // TODO: verify reassignment is correct
-        ctx.BuildResultStore();
-        if (summary.store.empty() ||
-            !EqualAbstractStore(ctx.Solver(), summary.store, ctx.ExportResultStore()))
+        unique_ptr<AnalysisContext> ctx;
+        if (warm_contexts != nullptr)
+        {
+            if (auto it = warm_contexts->find(summary.func); it != warm_contexts->end())
+            {
+                ctx = move(it->second);
+                warm_contexts->erase(it);
+            }
+        }
+
+        int num_runs                = 1;
+        int64_t num_queries_before  = 0;
+        vector<int> callee_versions = LookupCalleeVersions(env, summary);
+        if (ctx == nullptr)
+        {
+            ctx = make_unique<AnalysisContext>(&env, &summary);
+            AnalyzeFunctionBody(*ctx, warm_contexts != nullptr);
+        }
+        else if (callee_versions != summary.callee_versions)
+        {
+            num_queries_before = ctx->Solver().NumQueries();
+            ReanalyzeFunctionBody(*ctx, summary.callee_versions, callee_versions);
+        }
+        else
+        {
+            // nothing the analysis reads changed, thus it would reproduce the current summary
+            num_runs           = 0;
+            num_queries_before = ctx->Solver().NumQueries();
+        }
+
+        summary.callee_versions = move(callee_versions);
+
+        // the result store is kept intact in ctx for the data dependency stage
+        DataDependencyCounts counts;
+        AbstractStore store = CompactSummaryStore(summary, ctx->ExportResultStore());
+        bool updated =
+            summary.version == 0 || !EqualAbstractStore(ctx->Solver(), summary.store, store);
+        if (updated)
         {
             if (dependencies_converged)
             {
@@ -773,65 +1044,64 @@ namespace mh
             summary.converged = true;
         }
 
-#ifdef HEAP_ANALYSIS_DEBUG_MODE
-        if (summary.converged)
+        if (summary.converged && DataDependencyEnabled())
         {
-            int num_raw_store = 0;
-            int num_raw_call  = 0;
-            int num_raw_arg   = 0;
-
-            AnalyzeFunction_DataDep(ctx);
-            // fmt::print("[Data Dependency]\n");
-            // fmt::print("digraph DDG {{\n");
-            // for (auto& [dep_pair, constraint] : ctx.data_dep_result_)
-            // {
-            //     constraint.Simplify();
-            //     fmt::print("\"{}\" -> \"{}\" [label=\"{}\"]\n", *dep_pair.second,
-            //                *static_cast<const Value*>(dep_pair.first), constraint);
-            // }
-            // fmt::print("}}\n");
-            // mh::DebugPrint(ctx.ExportResultStore());
-
-            for (auto& [dep_pair, constraint] : ctx.data_dep_result_)
-            {
-                if (isa<StoreInst>(dep_pair.second))
-                {
-                    num_raw_store += 1;
-                }
-                else if (isa<CallInst>(dep_pair.second))
-                {
-                    num_raw_call += 1;
-                }
-                else if (isa<Argument>(dep_pair.second) || isa<GlobalVariable>(dep_pair.second))
-                {
-                    num_raw_arg += 1;
-                }
+            counts = ReportDataDependency(*ctx, t_analysis);
+        }
+
+        // the version only changes with the summary, so that callers reading an equivalent
+        // summary are not re-analyzed
+        if (updated)
+        {
+            env.UpdateSummaryStore(summary, move(store));
+        }
+        summary.summary_locs = ctx->SummaryLocations();
+
+        // a degraded summary depends on budgets and the timing of the analysis, thus isn't cached
+        if (cache != nullptr && summary.converged && !ctx->Degraded())
+        {
+            // keep the previous summary if the function changed without changing its summary, so
+            // that callers of the function still find their cached summaries
+            optional<CachedSummary> previous = cache->LoadPrevious(env, summary);
+            if (previous && previous->summary_locs == summary.summary_locs &&
+                EqualAbstractStore(ctx->Solver(), summary.store, previous->store))
+            {
+                cache->RestoreCallPoints(env, *previous);
+                cache->NotifyUnchanged();
+                env.UpdateSummaryStore(summary, move(previous->store));
             }
 
-            GLOBAL_NUM_RAW_STORE += num_raw_store;
-            GLOBAL_NUM_RAW_CALL += num_raw_call;
-            GLOBAL_NUM_RAW_ARG += num_raw_arg;
+            cache->Save(env, summary, counts);
+        }
 
-            using FpMilliseconds = std::chrono::duration<float, std::chrono::milliseconds::period>;
-            auto t_stop          = chrono::high_resolution_clock::now();
+        ResultExporter* exporter = env.Exporter();
+        if (exporter != nullptr && summary.converged)
+        {
+            exporter->ExportSummary(env, summary);
+        }
 
-            fmt::print("Run Time = {} ms\n", FpMilliseconds(t_stop - t_start).count());
+        RecordAnalysisCost(summary.stats, t_analysis, num_runs,
+                           ctx->Solver().NumQueries() - num_queries_before, ctx->Degraded());
 
-            fmt::print("Num RAW (load-store) = {}\n", num_raw_store);
-            fmt::print("Num RAW (load-call) = {}\n", num_raw_call);
-            fmt::print("Num RAW (load-arg) = {}\n", num_raw_arg);
-            fmt::print("Total RAW (load-store) = {}\n", GLOBAL_NUM_RAW_STORE);
-            fmt::print("Total RAW (load-call) = {}\n", GLOBAL_NUM_RAW_CALL);
-            fmt::print("Total RAW (load-arg) = {}\n", GLOBAL_NUM_RAW_ARG);
+        if (MemoryAccounting::Enabled())
+        {
+            MemoryAccounting::SampleSmtContext();
+            ctx->LocalMemoryUsage().Report(fmt::format("function {}", summary.func->getName()));
         }
-#endif
 
-        summary.store = move(ctx.ExportResultStore());
+        if (summary.converged)
+        {
+            env.NotifyConverged(summary);
+        }
+        else if (warm_contexts != nullptr)
+        {
+            (*warm_contexts)[summary.func] = move(ctx);
+        }
     }
 
     void AnalyzeFunctionRecursive(SummaryEnvironment& env, FunctionSummary& summary,
                                   unordered_set<const Function*>& analysis_history,
-                                  bool expect_converge)
+                                  WarmStartContexts& warm_contexts, bool expect_converge)
     {
         // function already in the call chain, omit analysis and return
         if (analysis_history.find(summary.func) != analysis_history.end())
@@ -854,7 +1124,8 @@ namespace mh
             {
                 if (!called_summary.converged)
                 {
-                    AnalyzeFunctionRecursive(env, called_summary, analysis_history, true);
+                    AnalyzeFunctionRecursive(env, called_summary, analysis_history, warm_contexts,
+                                             true);
                 }
 
                 assert(called_summary.converged);
@@ -876,14 +1147,17 @@ namespace mh
             {
                 if (!called_summmary->converged)
                 {
-                    AnalyzeFunctionRecursive(env, *called_summmary, analysis_history, false);
+                    AnalyzeFunctionRecursive(env, *called_summmary, analysis_history,
+                                             warm_contexts, false);
                 }
 
                 dep_converged = dep_converged && called_summmary->converged;
             }
 
-            // analyze the current function
-            AnalyzeFunctionAux(env, summary, dep_converged);
+            // analyze the current function, a recursive function only re-analyzes blocks calling
+            // summaries updated since its previous analysis
+            AnalyzeFunctionAux(env, summary, dep_converged,
+                               summary.func->doesNotRecurse() ? nullptr : &warm_contexts);
         } while (expect_converge && !summary.converged);
 
         // remove the current function from the call chain
@@ -899,11 +1173,162 @@ namespace mh
         }
 
         unordered_set<const Function*> analysis_history;
-        AnalyzeFunctionRecursive(env, summary, analysis_history, true);
+        WarmStartContexts warm_contexts;
+        AnalyzeFunctionRecursive(env, summary, analysis_history, warm_contexts, true);
+    }
+
+    void AnalyzeRecursiveComponent(SummaryEnvironment& env,
+                                   const std::vector<const llvm::Function*>& funcs,
+                                   const ParallelForFunction& parallel_for)
+    {
+        int num_members = funcs.size();
+
+        vector<FunctionSummary*> summaries;
+        unordered_map<const Function*, int> member_lookup;
+        for (const Function* func : funcs)
+        {
+            member_lookup[func] = summaries.size();
+            summaries.push_back(&env.LookupSummary(func));
+        }
+
+        // callers[i]: members calling member i
+        vector<vector<int>> callers(num_members);
+        for (int i = 0; i < num_members; ++i)
+        {
+            for (const Function* callee : summaries[i]->called_functions)
+            {
+                if (auto it = member_lookup.find(callee); it != member_lookup.end())
+                {
+                    callers[it->second].push_back(i);
+                }
+            }
+        }
+
+        // results are committed after the round, so that all members of a round read summaries
+        // of the previous round
+        struct RoundResult
+        {
+            bool updated = false;
+            AbstractStore store;
+            unordered_set<AbstractLocation> summary_locs;
+
+            // NOTE summaries may be copied by other members meanwhile, so their statistics are
+            // only updated after the round as well
+            AnalysisStatistics stats;
+        };
+
+        vector<int> scheduled(num_members);
+        iota(scheduled.begin(), scheduled.end(), 0);
+        while (!scheduled.empty())
+        {
+            vector<RoundResult> results(scheduled.size());
+            parallel_for(scheduled.size(), [&](int k) {
+                FunctionSummary& summary = *summaries[scheduled[k]];
+                auto t_analysis          = chrono::high_resolution_clock::now();
+
+                AnalysisContext ctx{&env, &summary};
+                AnalyzeFunctionBody(ctx);
+
+                // the previous summary may be in the smt context of another thread
+                const FunctionSummary& prev_summary =
+                    static_cast<const SummaryEnvironment&>(env).LookupSummary(summary.func);
+
+                AbstractStore store = CompactSummaryStore(summary, ctx.ExportResultStore());
+
+                RoundResult& result = results[k];
+                result.updated      = prev_summary.version == 0 ||
+                                 !EqualAbstractStore(ctx.Solver(), prev_summary.store, store);
+                if (result.updated)
+                {
+                    result.store        = env.ExportStore(store);
+                    result.summary_locs = ctx.SummaryLocations();
+                }
+
+                RecordAnalysisCost(result.stats, t_analysis, 1, ctx.Solver().NumQueries(),
+                                   ctx.Degraded());
+            });
+
+            vector<bool> next_scheduled(num_members, false);
+            for (int k = 0; k < scheduled.size(); ++k)
+            {
+                AnalysisStatistics& stats = summaries[scheduled[k]]->stats;
+                stats.num_runs += results[k].stats.num_runs;
+                stats.time_ms += results[k].stats.time_ms;
+                stats.num_solver_queries += results[k].stats.num_solver_queries;
+                stats.num_degraded_runs += results[k].stats.num_degraded_runs;
+
+                if (!results[k].updated)
+                {
+                    continue;
+                }
+
+                FunctionSummary& summary = *summaries[scheduled[k]];
+                env.PublishSummaryStore(summary, move(results[k].store));
+                summary.summary_locs = move(results[k].summary_locs);
+
+                for (int caller : callers[scheduled[k]])
+                {
+                    next_scheduled[caller] = true;
+                }
+            }
+
+            scheduled.clear();
+            for (int i = 0; i < num_members; ++i)
+            {
+                if (next_scheduled[i])
+                {
+                    scheduled.push_back(i);
+                }
+            }
+        }
+
+        for (FunctionSummary* summary : summaries)
+        {
+            summary->converged = true;
+        }
+
+        if (ResultExporter* exporter = env.Exporter())
+        {
+            // converged summaries are in the exchange context
+            const SummaryEnvironment& const_env = env;
+            for (const Function* func : funcs)
+            {
+                exporter->ExportSummary(env, const_env.LookupSummary(func));
+            }
+        }
+
+        if (DataDependencyEnabled())
+        {
+            // data dependencies are computed against the converged summaries
+            vector<AnalysisStatistics> report_stats(num_members);
+            parallel_for(num_members, [&](int i) {
+#ifdef HEAP_ANALYSIS_DEBUG_MODE
+                fmt::print("---------\n");
+                fmt::print("processing function {}\n", summaries[i]->func->getName());
+#endif
+
+                auto t_start = chrono::high_resolution_clock::now();
+
+                AnalysisContext ctx{&env, summaries[i]};
+                AnalyzeFunctionBody(ctx);
+                ReportDataDependency(ctx, t_start);
+
+                RecordAnalysisCost(report_stats[i], t_start, 1, ctx.Solver().NumQueries(),
+                                   ctx.Degraded());
+            });
+
+            for (int i = 0; i < num_members; ++i)
+            {
+                summaries[i]->stats.num_runs += report_stats[i].num_runs;
+                summaries[i]->stats.time_ms += report_stats[i].time_ms;
+                summaries[i]->stats.num_solver_queries += report_stats[i].num_solver_queries;
+                summaries[i]->stats.num_degraded_runs += report_stats[i].num_degraded_runs;
+            }
+        }
 
-        for (auto func : summary.called_functions)
+        for (FunctionSummary* summary : summaries)
         {
-            env.NotifyUse(func);
+            env.NotifyConverged(*summary);
         }
     }
 
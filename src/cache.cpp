@@ -0,0 +1,1073 @@
+#include "cache.h"
+#include "options.h"
+#include "summary.h"
+#include "utils/byte-utils.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+#include <algorithm>
+#include <utility>
+
+using namespace std;
+using namespace llvm;
+using namespace mh::detail;
+
+namespace mh
+{
+    namespace
+    {
+        constexpr char kCacheFileMagic[] = "HSUM";
+
+        // magic of per-function records, which point to the latest summary of a function
+        constexpr char kFunctionRecordMagic[] = "HFUN";
+
+        // bump when the encoding or the analysis changes in a way that invalidates old summaries
+        constexpr uint64_t kCacheFormatVersion = 1;
+
+        // kinds of definitions of locations
+        enum class DefinitionKind : uint8_t
+        {
+            Null,
+            Global,
+            Function,
+            Argument,
+            Instruction,
+
+            // constant by its text and an operand where it's used, as constants have no names
+            Constant,
+        };
+
+        // nodes of encoded constraint DAGs, children refer to earlier nodes
+        enum class ConstraintOp : uint8_t
+        {
+            False,
+            True,
+            Not,
+            And,
+            Or,
+
+            // x_i == x_j of two alias variables
+            AliasEq,
+
+            // any other term in SMT-LIB, with the number of alias variables to declare
+            SmtLib,
+        };
+
+        // number of alias variables needed to declare the variables in a term
+        int CountAliasVariables(const z3::expr& e, unordered_map<unsigned, int>& memo)
+        {
+            if (auto it = memo.find(e.id()); it != memo.end())
+            {
+                return it->second;
+            }
+
+            int result = SmtProvider::AliasVariableIndex(e) + 1;
+            if (e.is_app())
+            {
+                for (unsigned i = 0; i < e.num_args(); ++i)
+                {
+                    result = max(result, CountAliasVariables(e.arg(i), memo));
+                }
+            }
+
+            memo[e.id()] = result;
+            return result;
+        }
+
+        // writes constraint terms as a DAG of nodes, shared subterms are written once
+        class ConstraintEncoder
+        {
+        private:
+            ByteWriter nodes_;
+            int num_nodes_ = 0;
+            unordered_map<unsigned, int> node_lookup_;
+            unordered_map<unsigned, int> var_count_memo_;
+
+        public:
+            int NumNodes() const noexcept { return num_nodes_; }
+            const string& Buffer() const noexcept { return nodes_.Buffer(); }
+
+            int Encode(const z3::expr& e)
+            {
+                if (auto it = node_lookup_.find(e.id()); it != node_lookup_.end())
+                {
+                    return it->second;
+                }
+
+                vector<int> children;
+                if (e.is_not() || e.is_and() || e.is_or())
+                {
+                    for (unsigned i = 0; i < e.num_args(); ++i)
+                    {
+                        children.push_back(Encode(e.arg(i)));
+                    }
+                }
+
+                if (e.is_true())
+                {
+                    nodes_.WriteByte(static_cast<uint8_t>(ConstraintOp::True));
+                }
+                else if (e.is_false())
+                {
+                    nodes_.WriteByte(static_cast<uint8_t>(ConstraintOp::False));
+                }
+                else if (e.is_not())
+                {
+                    nodes_.WriteByte(static_cast<uint8_t>(ConstraintOp::Not));
+                    nodes_.WriteVarint(children[0]);
+                }
+                else if (e.is_and() || e.is_or())
+                {
+                    nodes_.WriteByte(
+                        static_cast<uint8_t>(e.is_and() ? ConstraintOp::And : ConstraintOp::Or));
+                    nodes_.WriteVarint(children.size());
+                    for (int child : children)
+                    {
+                        nodes_.WriteVarint(child);
+                    }
+                }
+                else if (SmtProvider::IsAliasExpr(e))
+                {
+                    nodes_.WriteByte(static_cast<uint8_t>(ConstraintOp::AliasEq));
+                    nodes_.WriteVarint(SmtProvider::AliasVariableIndex(e.arg(0)));
+                    nodes_.WriteVarint(SmtProvider::AliasVariableIndex(e.arg(1)));
+                }
+                else
+                {
+                    nodes_.WriteByte(static_cast<uint8_t>(ConstraintOp::SmtLib));
+                    nodes_.WriteVarint(CountAliasVariables(e, var_count_memo_));
+                    nodes_.WriteString(e.to_string());
+                }
+
+                int index = num_nodes_++;
+                node_lookup_[e.id()] = index;
+                return index;
+            }
+        };
+
+        // hash of constraint terms independent of the smt context, shared subterms are hashed once
+        class ConstraintHasher
+        {
+        private:
+            unordered_map<unsigned, uint64_t> memo_;
+
+        public:
+            uint64_t Hash(const z3::expr& e)
+            {
+                if (auto it = memo_.find(e.id()); it != memo_.end())
+                {
+                    return it->second;
+                }
+
+                ByteWriter writer;
+                if (e.is_true() || e.is_false())
+                {
+                    writer.WriteByte(
+                        static_cast<uint8_t>(e.is_true() ? ConstraintOp::True : ConstraintOp::False));
+                }
+                else if (e.is_not() || e.is_and() || e.is_or())
+                {
+                    ConstraintOp op = e.is_not()   ? ConstraintOp::Not
+                                      : e.is_and() ? ConstraintOp::And
+                                                   : ConstraintOp::Or;
+                    // conjunctions and disjunctions are hashed regardless of the order of terms,
+                    // which depends on the order of edges in the store
+                    vector<uint64_t> children;
+                    for (unsigned i = 0; i < e.num_args(); ++i)
+                    {
+                        children.push_back(Hash(e.arg(i)));
+                    }
+
+                    std::sort(children.begin(), children.end());
+
+                    writer.WriteByte(static_cast<uint8_t>(op));
+                    writer.WriteVarint(children.size());
+                    for (uint64_t child : children)
+                    {
+                        writer.WriteVarint(child);
+                    }
+                }
+                else if (SmtProvider::IsAliasExpr(e))
+                {
+                    writer.WriteByte(static_cast<uint8_t>(ConstraintOp::AliasEq));
+                    writer.WriteVarint(SmtProvider::AliasVariableIndex(e.arg(0)));
+                    writer.WriteVarint(SmtProvider::AliasVariableIndex(e.arg(1)));
+                }
+                else
+                {
+                    writer.WriteByte(static_cast<uint8_t>(ConstraintOp::SmtLib));
+                    writer.WriteString(e.to_string());
+                }
+
+                return memo_[e.id()] = writer.Hash();
+            }
+        };
+
+        // rebuild constraint terms written by ConstraintEncoder in the smt context of the current
+        // thread, throws z3::exception on malformed SMT-LIB terms
+        bool ReadConstraintNodes(ByteReader& reader, vector<z3::expr>& nodes)
+        {
+            SmtProvider& provider = SmtProvider::Current();
+            z3::context& ctx      = provider.Context();
+
+            auto read_alias_var = [&]() -> optional<z3::expr> {
+                uint64_t i = reader.ReadVarint();
+                if (reader.Failed() || i >= (1u << 16))
+                {
+                    return nullopt;
+                }
+
+                provider.ReserveAliasVariables(i + 1);
+                return provider.AliasLocation(i);
+            };
+            auto read_child = [&]() -> optional<z3::expr> {
+                uint64_t i = reader.ReadVarint();
+                if (reader.Failed() || i >= nodes.size())
+                {
+                    return nullopt;
+                }
+
+                return nodes[i];
+            };
+
+            size_t num_nodes = reader.ReadCount();
+            for (size_t k = 0; k < num_nodes && !reader.Failed(); ++k)
+            {
+                ConstraintOp op = static_cast<ConstraintOp>(reader.ReadByte());
+                switch (op)
+                {
+                case ConstraintOp::False:
+                case ConstraintOp::True:
+                    nodes.push_back(ctx.bool_val(op == ConstraintOp::True));
+                    break;
+                case ConstraintOp::Not:
+                {
+                    optional<z3::expr> arg = read_child();
+                    if (!arg)
+                    {
+                        return false;
+                    }
+
+                    nodes.push_back(!*arg);
+                    break;
+                }
+                case ConstraintOp::And:
+                case ConstraintOp::Or:
+                {
+                    z3::expr_vector args{ctx};
+                    size_t num_args = reader.ReadCount();
+                    for (size_t i = 0; i < num_args; ++i)
+                    {
+                        optional<z3::expr> arg = read_child();
+                        if (!arg)
+                        {
+                            return false;
+                        }
+
+                        args.push_back(*arg);
+                    }
+
+                    nodes.push_back(op == ConstraintOp::And ? z3::mk_and(args) : z3::mk_or(args));
+                    break;
+                }
+                case ConstraintOp::AliasEq:
+                {
+                    optional<z3::expr> lhs = read_alias_var();
+                    optional<z3::expr> rhs = read_alias_var();
+                    if (!lhs || !rhs)
+                    {
+                        return false;
+                    }
+
+                    nodes.push_back(*lhs == *rhs);
+                    break;
+                }
+                case ConstraintOp::SmtLib:
+                {
+                    uint64_t num_vars = reader.ReadVarint();
+                    string text       = reader.ReadString().str();
+                    if (reader.Failed() || num_vars > (1u << 16))
+                    {
+                        return false;
+                    }
+
+                    provider.ReserveAliasVariables(num_vars);
+
+                    z3::sort_vector sorts{ctx};
+                    z3::func_decl_vector decls{ctx};
+                    for (int i = 0; i < num_vars; ++i)
+                    {
+                        decls.push_back(provider.AliasLocation(i).decl());
+                    }
+
+                    z3::expr_vector parsed =
+                        ctx.parse_string(fmt::format("(assert {})", text).c_str(), sorts, decls);
+                    if (parsed.size() != 1)
+                    {
+                        return false;
+                    }
+
+                    nodes.push_back(parsed[0]);
+                    break;
+                }
+                default:
+                    return false;
+                }
+            }
+
+            return !reader.Failed();
+        }
+
+        // Reads and writes locations by names of their definitions and positions in functions
+        class LocationCodec
+        {
+        private:
+            SummaryCache& cache_;
+            const SummaryEnvironment& env_;
+
+            // write constants by their text only, so that the encoding doesn't depend on other
+            // functions using them, the result can't be read
+            bool text_only_;
+
+            // call points restored by Read that were collapsed when written
+            vector<int> collapsed_call_points_;
+
+        public:
+            LocationCodec(SummaryCache& cache, const SummaryEnvironment& env,
+                          bool text_only = false)
+                : cache_(cache), env_(env), text_only_(text_only)
+            {
+            }
+
+            // returns false if the definition can't be named
+            bool Write(ByteWriter& writer, const AbstractLocation& loc)
+            {
+                writer.WriteByte(static_cast<uint8_t>(loc.Tag()));
+                if (!WriteDefinition(writer, loc.Definition()))
+                {
+                    return false;
+                }
+
+                switch (loc.Tag())
+                {
+                case LocationTag::Dynamic:
+                    writer.WriteVarint(loc.DerefLevel());
+                    return true;
+                case LocationTag::Register:
+                    return true;
+                case LocationTag::Alloc:
+                case LocationTag::Value:
+                {
+                    // chain of call points from the outermost one
+                    vector<CallPointData> chain;
+                    for (int id = loc.CallPoint(); id > 0; id = chain.back().prev_call_point)
+                    {
+                        chain.push_back(env_.LookupCallPoint(id));
+                    }
+
+                    writer.WriteVarint(chain.size());
+                    for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+                    {
+                        if (!WriteDefinition(writer, it->inst))
+                        {
+                            return false;
+                        }
+
+                        writer.WriteByte(it->depth_to_collapse == 0);
+                    }
+
+                    return true;
+                }
+                }
+
+                return false;
+            }
+
+            optional<AbstractLocation> Read(ByteReader& reader, const Module& module)
+            {
+                uint8_t tag = reader.ReadByte();
+                if (tag > static_cast<uint8_t>(LocationTag::Value))
+                {
+                    return nullopt;
+                }
+
+                optional<const Value*> def = ReadDefinition(reader, module);
+                if (!def)
+                {
+                    return nullopt;
+                }
+
+                switch (static_cast<LocationTag>(tag))
+                {
+                case LocationTag::Dynamic:
+                {
+                    uint64_t deref_level = reader.ReadVarint();
+                    if (*def == nullptr || deref_level > GetPointerNestLevel((*def)->getType()))
+                    {
+                        return nullopt;
+                    }
+
+                    return AbstractLocation::FromRuntimeMemory(*def, deref_level);
+                }
+                case LocationTag::Register:
+                    if (*def == nullptr)
+                    {
+                        return nullopt;
+                    }
+
+                    return AbstractLocation::FromRegister(*def);
+                case LocationTag::Alloc:
+                case LocationTag::Value:
+                {
+                    // NOTE call points are derived in the recorded order, and collapsed after the
+                    // whole summary is read, so that the chain allocates the same call points
+                    int call_point    = 0;
+                    size_t num_chains = reader.ReadCount();
+                    for (size_t i = 0; i < num_chains; ++i)
+                    {
+                        optional<const Value*> inst = ReadDefinition(reader, module);
+                        bool collapsed              = reader.ReadByte() != 0;
+                        if (!inst || !isa_and_nonnull<Instruction>(*inst))
+                        {
+                            return nullopt;
+                        }
+
+                        call_point = env_.ComputeCallPoint(cast<Instruction>(*inst), call_point);
+                        if (collapsed)
+                        {
+                            collapsed_call_points_.push_back(call_point);
+                        }
+                    }
+
+                    return AbstractLocation{static_cast<LocationTag>(tag), *def, call_point};
+                }
+                }
+
+                return nullopt;
+            }
+
+            vector<int> TakeCollapsedCallPoints()
+            {
+                return std::exchange(collapsed_call_points_, {});
+            }
+
+        private:
+            bool WriteDefinition(ByteWriter& writer, const Value* def)
+            {
+                if (def == nullptr)
+                {
+                    writer.WriteByte(static_cast<uint8_t>(DefinitionKind::Null));
+                    return true;
+                }
+
+                if (auto global_var = dyn_cast<GlobalVariable>(def))
+                {
+                    writer.WriteByte(static_cast<uint8_t>(DefinitionKind::Global));
+                    writer.WriteString(global_var->getName());
+                    return global_var->hasName();
+                }
+                else if (auto func = dyn_cast<Function>(def))
+                {
+                    writer.WriteByte(static_cast<uint8_t>(DefinitionKind::Function));
+                    writer.WriteString(func->getName());
+                    return func->hasName();
+                }
+                else if (auto arg = dyn_cast<Argument>(def))
+                {
+                    writer.WriteByte(static_cast<uint8_t>(DefinitionKind::Argument));
+                    writer.WriteString(arg->getParent()->getName());
+                    writer.WriteVarint(arg->getArgNo());
+                    return arg->getParent()->hasName();
+                }
+                else if (auto inst = dyn_cast<Instruction>(def))
+                {
+                    writer.WriteByte(static_cast<uint8_t>(DefinitionKind::Instruction));
+                    writer.WriteString(inst->getFunction()->getName());
+                    writer.WriteVarint(cache_.InstructionIndex(inst));
+                    return inst->getFunction()->hasName();
+                }
+                else if (auto constant = dyn_cast<Constant>(def))
+                {
+                    writer.WriteByte(static_cast<uint8_t>(DefinitionKind::Constant));
+                    writer.WriteString(PrintConstant(constant));
+                    if (text_only_)
+                    {
+                        return true;
+                    }
+
+                    for (const Use& use : constant->uses())
+                    {
+                        auto user = dyn_cast<Instruction>(use.getUser());
+                        if (user != nullptr && user->getFunction()->hasName())
+                        {
+                            writer.WriteString(user->getFunction()->getName());
+                            writer.WriteVarint(cache_.InstructionIndex(user));
+                            writer.WriteVarint(use.getOperandNo());
+                            return true;
+                        }
+                    }
+                }
+
+                return false;
+            }
+
+            static string PrintConstant(const Constant* constant)
+            {
+                string text;
+                raw_string_ostream os{text};
+                constant->print(os);
+                return os.str();
+            }
+
+            // returns nullopt if the definition doesn't exist in the module, or a null definition
+            optional<const Value*> ReadDefinition(ByteReader& reader, const Module& module)
+            {
+                DefinitionKind kind = static_cast<DefinitionKind>(reader.ReadByte());
+                if (kind == DefinitionKind::Null)
+                {
+                    return reader.Failed() ? nullopt : optional<const Value*>{nullptr};
+                }
+
+                StringRef name = reader.ReadString();
+                if (reader.Failed())
+                {
+                    return nullopt;
+                }
+
+                const Value* result = nullptr;
+                switch (kind)
+                {
+                case DefinitionKind::Global:
+                    result = module.getNamedGlobal(name);
+                    break;
+                case DefinitionKind::Function:
+                    result = module.getFunction(name);
+                    break;
+                case DefinitionKind::Argument:
+                {
+                    const Function* func = module.getFunction(name);
+                    uint64_t arg_no      = reader.ReadVarint();
+                    if (func != nullptr && arg_no < func->arg_size())
+                    {
+                        result = func->getArg(arg_no);
+                    }
+                    break;
+                }
+                case DefinitionKind::Instruction:
+                {
+                    const Function* func = module.getFunction(name);
+                    uint64_t index       = reader.ReadVarint();
+                    if (func != nullptr && index < (1u << 31))
+                    {
+                        result = cache_.InstructionAt(func, index);
+                    }
+                    break;
+                }
+                case DefinitionKind::Constant:
+                {
+                    // `name` is the text of the constant, validated against the operand
+                    const Function* func        = module.getFunction(reader.ReadString());
+                    uint64_t index              = reader.ReadVarint();
+                    uint64_t operand_no         = reader.ReadVarint();
+                    const Instruction* user     = func != nullptr && index < (1u << 31)
+                                                      ? cache_.InstructionAt(func, index)
+                                                      : nullptr;
+                    if (user != nullptr && operand_no < user->getNumOperands())
+                    {
+                        auto constant = dyn_cast<Constant>(user->getOperand(operand_no));
+                        if (constant != nullptr && PrintConstant(constant) == name)
+                        {
+                            result = constant;
+                        }
+                    }
+                    break;
+                }
+                default:
+                    break;
+                }
+
+                if (result == nullptr || reader.Failed())
+                {
+                    return nullopt;
+                }
+
+                return result;
+            }
+        };
+
+        optional<CachedSummary> ReadCachedSummary(ByteReader& reader, LocationCodec& codec,
+                                                  const FunctionSummary& summary, uint64_t key)
+        {
+            const Module& module = *summary.func->getParent();
+
+            if (reader.ReadBytes(sizeof(kCacheFileMagic) - 1) != kCacheFileMagic ||
+                reader.ReadVarint() != kCacheFormatVersion || reader.ReadVarint() != key ||
+                reader.ReadString() != summary.func->getName() || reader.Failed())
+            {
+                return nullopt;
+            }
+
+            CachedSummary result;
+            result.counts.num_raw_store = reader.ReadVarint();
+            result.counts.num_raw_call  = reader.ReadVarint();
+            result.counts.num_raw_arg   = reader.ReadVarint();
+
+            vector<AbstractLocation> locs;
+            size_t num_locs = reader.ReadCount();
+            for (size_t i = 0; i < num_locs; ++i)
+            {
+                optional<AbstractLocation> loc = codec.Read(reader, module);
+                if (!loc)
+                {
+                    return nullopt;
+                }
+
+                locs.push_back(*loc);
+            }
+
+            vector<z3::expr> nodes;
+            if (!ReadConstraintNodes(reader, nodes))
+            {
+                return nullopt;
+            }
+
+            auto read_index = [&](size_t size) -> optional<size_t> {
+                uint64_t i = reader.ReadVarint();
+                if (reader.Failed() || i >= size)
+                {
+                    return nullopt;
+                }
+
+                return i;
+            };
+
+            size_t num_entries = reader.ReadCount();
+            for (size_t i = 0; i < num_entries; ++i)
+            {
+                optional<size_t> loc = read_index(locs.size());
+                if (!loc)
+                {
+                    return nullopt;
+                }
+
+                PointToMap& pt_map = result.store[locs[*loc]];
+                size_t num_edges   = reader.ReadCount();
+                for (size_t j = 0; j < num_edges; ++j)
+                {
+                    optional<size_t> target = read_index(locs.size());
+                    optional<size_t> may    = read_index(nodes.size());
+                    optional<size_t> must   = read_index(nodes.size());
+                    if (!target || !may || !must)
+                    {
+                        return nullopt;
+                    }
+
+                    pt_map.insert(pair{locs[*target], Constraint{nodes[*may], nodes[*must]}});
+                }
+            }
+
+            size_t num_summary_locs = reader.ReadCount();
+            for (size_t i = 0; i < num_summary_locs; ++i)
+            {
+                optional<size_t> loc = read_index(locs.size());
+                if (!loc)
+                {
+                    return nullopt;
+                }
+
+                result.summary_locs.insert(locs[*loc]);
+            }
+
+            if (reader.Failed())
+            {
+                return nullopt;
+            }
+
+            result.collapsed_call_points = codec.TakeCollapsedCallPoints();
+            return result;
+        }
+
+        // write a file through a temporary one, so that a concurrent or interrupted run never reads
+        // a partially written file
+        void WriteFileAtomic(const string& directory, const string& path, const string& content)
+        {
+            SmallString<128> temp_path;
+            int fd;
+            if (sys::fs::create_directories(directory) ||
+                sys::fs::createUniqueFile(path + ".%%%%%%.tmp", fd, temp_path))
+            {
+                return;
+            }
+
+            {
+                raw_fd_ostream os{fd, /*shouldClose=*/true};
+                os << content;
+                os.close();
+                if (os.has_error())
+                {
+                    os.clear_error();
+                    sys::fs::remove(temp_path);
+                    return;
+                }
+            }
+
+            if (sys::fs::rename(temp_path, path))
+            {
+                sys::fs::remove(temp_path);
+            }
+        }
+
+        // returns nullopt if a location can't be written
+        optional<string> WriteCachedSummary(LocationCodec& codec, const FunctionSummary& summary,
+                                            uint64_t key, const DataDependencyCounts& counts)
+        {
+            ByteWriter locs;
+            int num_locs = 0;
+            unordered_map<AbstractLocation, int> loc_lookup;
+            auto loc_index = [&](const AbstractLocation& loc) -> optional<int> {
+                if (auto it = loc_lookup.find(loc); it != loc_lookup.end())
+                {
+                    return it->second;
+                }
+
+                if (!codec.Write(locs, loc))
+                {
+                    return nullopt;
+                }
+
+                return loc_lookup[loc] = num_locs++;
+            };
+
+            ConstraintEncoder constraints;
+            ByteWriter store;
+            store.WriteVarint(summary.store.size());
+            for (const auto& [loc, pt_map] : summary.store)
+            {
+                optional<int> loc_i = loc_index(loc);
+                if (!loc_i)
+                {
+                    return nullopt;
+                }
+
+                store.WriteVarint(*loc_i);
+                store.WriteVarint(pt_map.size());
+                for (const auto& [target, c] : pt_map)
+                {
+                    optional<int> target_i = loc_index(target);
+                    if (!target_i)
+                    {
+                        return nullopt;
+                    }
+
+                    store.WriteVarint(*target_i);
+                    store.WriteVarint(constraints.Encode(c.GetMayExpr()));
+                    store.WriteVarint(constraints.Encode(c.GetMustExpr()));
+                }
+            }
+
+            store.WriteVarint(summary.summary_locs.size());
+            for (const AbstractLocation& loc : summary.summary_locs)
+            {
+                optional<int> loc_i = loc_index(loc);
+                if (!loc_i)
+                {
+                    return nullopt;
+                }
+
+                store.WriteVarint(*loc_i);
+            }
+
+            ByteWriter writer;
+            writer.WriteBytes(StringRef{kCacheFileMagic, sizeof(kCacheFileMagic) - 1});
+            writer.WriteVarint(kCacheFormatVersion);
+            writer.WriteVarint(key);
+            writer.WriteString(summary.func->getName());
+            writer.WriteVarint(counts.num_raw_store);
+            writer.WriteVarint(counts.num_raw_call);
+            writer.WriteVarint(counts.num_raw_arg);
+            writer.WriteVarint(num_locs);
+            writer.WriteBytes(locs.Buffer());
+            writer.WriteVarint(constraints.NumNodes());
+            writer.WriteBytes(constraints.Buffer());
+            writer.WriteBytes(store.Buffer());
+
+            return writer.Buffer();
+        }
+    } // namespace
+
+    SummaryCache::SummaryCache(std::string directory) : directory_(move(directory)) {}
+
+    std::optional<CachedSummary> SummaryCache::Load(const SummaryEnvironment& env,
+                                                    const FunctionSummary& summary)
+    {
+        optional<CachedSummary> result;
+        if (optional<uint64_t> key = ComputeKey(env, summary))
+        {
+            result = ReadCacheFile(env, summary, *key);
+        }
+
+        if (result)
+        {
+            RestoreCallPoints(env, *result);
+        }
+
+        (result ? num_hits_ : num_misses_) += 1;
+        return result;
+    }
+
+    std::optional<CachedSummary> SummaryCache::LoadPrevious(const SummaryEnvironment& env,
+                                                            const FunctionSummary& summary)
+    {
+        auto buffer = MemoryBuffer::getFile(FunctionRecordPath(summary.func));
+        if (!buffer)
+        {
+            return nullopt;
+        }
+
+        ByteReader reader{(*buffer)->getBuffer()};
+        if (reader.ReadBytes(sizeof(kFunctionRecordMagic) - 1) != kFunctionRecordMagic ||
+            reader.ReadVarint() != kCacheFormatVersion ||
+            reader.ReadString() != summary.func->getName())
+        {
+            return nullopt;
+        }
+
+        uint64_t key = reader.ReadVarint();
+        if (reader.Failed())
+        {
+            return nullopt;
+        }
+
+        return ReadCacheFile(env, summary, key);
+    }
+
+    void SummaryCache::RestoreCallPoints(const SummaryEnvironment& env,
+                                         const CachedSummary& cached)
+    {
+        for (int call_point : cached.collapsed_call_points)
+        {
+            if (call_point > 0)
+            {
+                env.CollapseCallPoint(call_point);
+            }
+        }
+    }
+
+    void SummaryCache::NotifyUnchanged()
+    {
+        num_unchanged_ += 1;
+    }
+
+    void SummaryCache::Save(const SummaryEnvironment& env, const FunctionSummary& summary,
+                            const DataDependencyCounts& counts)
+    {
+        optional<uint64_t> key = ComputeKey(env, summary);
+        if (!key)
+        {
+            return;
+        }
+
+        LocationCodec codec{*this, env};
+        optional<string> content = WriteCachedSummary(codec, summary, *key, counts);
+        if (!content)
+        {
+            return;
+        }
+
+        WriteFileAtomic(directory_, CacheFilePath(*key), *content);
+
+        // point the record of the function to the summary, for LoadPrevious of later runs
+        ByteWriter record;
+        record.WriteBytes(StringRef{kFunctionRecordMagic, sizeof(kFunctionRecordMagic) - 1});
+        record.WriteVarint(kCacheFormatVersion);
+        record.WriteString(summary.func->getName());
+        record.WriteVarint(*key);
+        WriteFileAtomic(directory_, FunctionRecordPath(summary.func), record.Buffer());
+    }
+
+    int SummaryCache::InstructionIndex(const llvm::Instruction* inst)
+    {
+        lock_guard<mutex> lock{mutex_};
+
+        IndexInstructions(inst->getFunction());
+        return instruction_index_.at(inst);
+    }
+
+    const llvm::Instruction* SummaryCache::InstructionAt(const llvm::Function* func, int index)
+    {
+        lock_guard<mutex> lock{mutex_};
+
+        IndexInstructions(func);
+        const vector<const Instruction*>& insts = instructions_.at(func);
+        return index >= 0 && index < insts.size() ? insts[index] : nullptr;
+    }
+
+    std::optional<uint64_t> SummaryCache::ComputeKey(const SummaryEnvironment& env,
+                                                     const FunctionSummary& summary)
+    {
+        {
+            lock_guard<mutex> lock{mutex_};
+            if (auto it = keys_.find(summary.func); it != keys_.end())
+            {
+                return it->second;
+            }
+        }
+
+        string ir;
+        raw_string_ostream os{ir};
+        summary.func->print(os);
+        os.flush();
+
+        ByteWriter writer;
+        writer.WriteVarint(kCacheFormatVersion);
+        writer.WriteString(ir);
+        writer.WriteVarint(AnalysisOptions::Current().sparse_store);
+        writer.WriteVarint(AnalysisOptions::Current().widening_delay);
+
+        // data dependency counts are only saved if they are computed
+        writer.WriteVarint(DataDependencyEnabled());
+
+        for (const Function* callee : summary.called_functions)
+        {
+            // TODO: workaround, why nullptr?
+            if (callee == nullptr)
+            {
+                continue;
+            }
+
+            optional<uint64_t> fingerprint = ComputeFingerprint(env, env.LookupSummary(callee));
+            if (!fingerprint)
+            {
+                return nullopt;
+            }
+
+            writer.WriteString(callee->getName());
+            writer.WriteVarint(*fingerprint);
+        }
+
+        lock_guard<mutex> lock{mutex_};
+        return keys_[summary.func] = writer.Hash();
+    }
+
+    std::optional<uint64_t> SummaryCache::ComputeFingerprint(const SummaryEnvironment& env,
+                                                             const FunctionSummary& summary)
+    {
+        {
+            lock_guard<mutex> lock{mutex_};
+            if (auto it = fingerprints_.find(summary.func);
+                it != fingerprints_.end() && it->second.first == summary.version)
+            {
+                return it->second.second;
+            }
+        }
+
+        ByteWriter writer;
+        writer.WriteString(summary.func->getName());
+        for (const GlobalVariable* global_var : summary.globals)
+        {
+            writer.WriteString(global_var->getName());
+        }
+
+        // entries and edges are unordered, so their hashes are combined by summation
+        LocationCodec codec{*this, env, /*text_only=*/true};
+        ConstraintHasher hasher;
+        uint64_t store_hash = 0;
+        for (const auto& [loc, pt_map] : summary.store)
+        {
+            ByteWriter loc_writer;
+            if (!codec.Write(loc_writer, loc))
+            {
+                return nullopt;
+            }
+
+            uint64_t edges_hash = 0;
+            for (const auto& [target, c] : pt_map)
+            {
+                ByteWriter edge_writer;
+                if (!codec.Write(edge_writer, target))
+                {
+                    return nullopt;
+                }
+
+                edge_writer.WriteVarint(hasher.Hash(c.GetMayExpr()));
+                edge_writer.WriteVarint(hasher.Hash(c.GetMustExpr()));
+                edges_hash += edge_writer.Hash();
+            }
+
+            loc_writer.WriteVarint(pt_map.size());
+            loc_writer.WriteVarint(edges_hash);
+            store_hash += loc_writer.Hash();
+        }
+
+        uint64_t summary_locs_hash = 0;
+        for (const AbstractLocation& loc : summary.summary_locs)
+        {
+            ByteWriter loc_writer;
+            if (!codec.Write(loc_writer, loc))
+            {
+                return nullopt;
+            }
+
+            summary_locs_hash += loc_writer.Hash();
+        }
+
+        writer.WriteVarint(store_hash);
+        writer.WriteVarint(summary_locs_hash);
+
+        lock_guard<mutex> lock{mutex_};
+        fingerprints_[summary.func] = {summary.version, writer.Hash()};
+        return writer.Hash();
+    }
+
+    std::optional<CachedSummary> SummaryCache::ReadCacheFile(const SummaryEnvironment& env,
+                                                             const FunctionSummary& summary,
+                                                             uint64_t key)
+    {
+        auto buffer = MemoryBuffer::getFile(CacheFilePath(key));
+        if (!buffer)
+        {
+            return nullopt;
+        }
+
+        ByteReader reader{(*buffer)->getBuffer()};
+        LocationCodec codec{*this, env};
+        try
+        {
+            return ReadCachedSummary(reader, codec, summary, key);
+        }
+        catch (const z3::exception&)
+        {
+            return nullopt;
+        }
+    }
+
+    std::string SummaryCache::CacheFilePath(uint64_t key) const
+    {
+        return fmt::format("{}/{:016x}.hsum", directory_, key);
+    }
+
+    std::string SummaryCache::FunctionRecordPath(const llvm::Function* func) const
+    {
+        return fmt::format("{}/{:016x}.hfun", directory_, xxHash64(func->getName()));
+    }
+
+    void SummaryCache::IndexInstructions(const llvm::Function* func)
+    {
+        auto [it, inserted] = instructions_.try_emplace(func);
+        if (!inserted)
+        {
+            return;
+        }
+
+        for (const BasicBlock& bb : *func)
+        {
+            for (const Instruction& inst : bb)
+            {
+                instruction_index_[&inst] = it->second.size();
+                it->second.push_back(&inst);
+            }
+        }
+    }
+} // namespace mh
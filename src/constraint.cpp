@@ -2,9 +2,34 @@
 
 namespace mh
 {
+    thread_local const char* g_tag = "?"; std::map<std::string,int> g_tagc; struct Dump { ~Dump() { for (auto& [k,v] : g_tagc) fprintf(stderr, "TAG %s %d\n", k.c_str(), v); } } g_dump;
+    int SmtProvider::AliasVariableIndex(const z3::expr& e)
+    {
+        if (!e.is_const() || !e.is_int())
+        {
+            return -1;
+        }
+
+        std::string name = e.decl().name().str();
+        if (name.size() < 2 || name[0] != 'x' ||
+            name.find_first_not_of("0123456789", 1) != std::string::npos)
+        {
+            return -1;
+        }
+
+        return std::stoi(name.substr(1));
+    }
+
+    bool SmtProvider::IsAliasExpr(const z3::expr& e)
+    {
+        return e.is_eq() && e.num_args() == 2 && AliasVariableIndex(e.arg(0)) >= 0 &&
+               AliasVariableIndex(e.arg(1)) >= 0;
+    }
+
     // test if a constraint could hold
     bool ConstraintSolver::TestSatisfiability(const Constraint& c)
     {
+        
         if (c.IsBottomLiteral())
         {
             return false;
@@ -20,6 +45,7 @@ namespace mh
     // test if a constraint always holds
     bool ConstraintSolver::TestValidity(const Constraint& c)
     {
+        struct T { const char* o = g_tag; ~T() { g_tag = o; } } t_; if (true) g_tag = "TestValidity";
         if (c.IsBottomLiteral())
         {
             return false;
@@ -34,6 +60,7 @@ namespace mh
 
     bool ConstraintSolver::TestImplication(const Constraint& c0, const Constraint& c1)
     {
+        struct T { const char* o = g_tag; ~T() { g_tag = o; } } t_; if (true) g_tag = "TestImplication";
         if (c0.HasSameMayMust() && c1.HasSameMayMust())
         {
             return TestImplicationAux(c0.GetMustExpr(), c1.GetMustExpr());
@@ -47,6 +74,7 @@ namespace mh
 
     bool ConstraintSolver::TestEquivalence(const Constraint& c0, const Constraint& c1)
     {
+        struct T { const char* o = g_tag; ~T() { g_tag = o; } } t_; if (true) g_tag = "TestEquivalence";
         if (c0.HasSameMayMust() != c1.HasSameMayMust())
         {
             return false;
@@ -101,6 +129,9 @@ namespace mh
         {
             solver.add(input_loc_vars_[i] != input_loc_vars_[j]);
             alias_rej_list_[i * num_inputs_ + j] = true;
+
+            // terms satisfiable before may not be any more
+            sat_cache_.clear();
         }
     }
 
@@ -1,116 +1,243 @@
 #include "controlflow.h"
 #include "llvm/IR/CFG.h"
 #include "llvm/Analysis/CFG.h"
-#include <deque>
+#include "llvm/Analysis/PostDominators.h"
+#include "llvm/ADT/DepthFirstIterator.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include <limits>
+#include <unordered_map>
 
 using namespace std;
 using namespace llvm;
 
 namespace mh
 {
-    FunctionControlFlowInfo::FunctionControlFlowInfo(const llvm::Function* func)
+    WeakTopologicalOrder::WeakTopologicalOrder(const llvm::Function* func)
     {
-        ComputeBackEdges(func);
-        ComputeExecAfterLookup(func);
-        ComputeInstructionIndexLookup(func);
+        // (block, number of blocks in its component, is head)
+        struct Element
+        {
+            const BasicBlock* bb;
+            int size;
+            bool head;
+        };
+        using Partition = vector<Element>;
+
+        constexpr int kVisitedDfn = numeric_limits<int>::max();
+
+        unordered_map<const BasicBlock*, int> dfn;
+        vector<const BasicBlock*> stack;
+        int num = 0;
+
+        // elements of a partition are prepended in Bourdoncle's algorithm, here they are appended
+        // as pieces in reversed order
+        auto flatten = [](vector<Partition>& pieces, Partition& result) {
+            for (auto it = pieces.rbegin(); it != pieces.rend(); ++it)
+            {
+                result.insert(result.end(), it->begin(), it->end());
+            }
+        };
+
+        auto visit = [&](const BasicBlock* bb, vector<Partition>& pieces, auto& self) -> int {
+            stack.push_back(bb);
+            dfn[bb]  = ++num;
+            int head = num;
+            bool loop = false;
+
+            for (const BasicBlock* succ_bb : successors(bb))
+            {
+                int succ_dfn = dfn[succ_bb];
+                int min_dfn  = succ_dfn == 0 ? self(succ_bb, pieces, self) : succ_dfn;
+                if (min_dfn <= head)
+                {
+                    head = min_dfn;
+                    loop = true;
+                }
+            }
+
+            if (head == dfn[bb])
+            {
+                dfn[bb] = kVisitedDfn;
+
+                const BasicBlock* element = stack.back();
+                stack.pop_back();
+                if (loop)
+                {
+                    while (element != bb)
+                    {
+                        dfn[element] = 0;
+                        element      = stack.back();
+                        stack.pop_back();
+                    }
+
+                    // component of bb
+                    vector<Partition> component_pieces;
+                    for (const BasicBlock* succ_bb : successors(bb))
+                    {
+                        if (dfn[succ_bb] == 0)
+                        {
+                            self(succ_bb, component_pieces, self);
+                        }
+                    }
+
+                    Partition component{Element{bb, 1, true}};
+                    flatten(component_pieces, component);
+                    component.front().size = component.size();
+                    pieces.push_back(move(component));
+                }
+                else
+                {
+                    pieces.push_back(Partition{Element{bb, 1, false}});
+                }
+            }
+
+            return head;
+        };
+
+        Partition partition;
+        for (const BasicBlock& bb : *func)
+        {
+            // start from the entry block, then blocks unreachable from visited ones
+            if (dfn[&bb] == 0)
+            {
+                vector<Partition> pieces;
+                visit(&bb, pieces, visit);
+                flatten(pieces, partition);
+            }
+        }
+
+        for (const Element& element : partition)
+        {
+            component_end_.push_back(order_.size() + element.size);
+            order_.push_back(element.bb);
+            if (element.head)
+            {
+                heads_.insert(element.bb);
+            }
+        }
+    }
+
+    FunctionNumbering::FunctionNumbering(const llvm::Function* func)
+    {
+        for (const Argument& arg : func->args())
+        {
+            value_numbers_[&arg] = values_.size();
+            values_.push_back(&arg);
+        }
+
+        for (const BasicBlock& bb : *func)
+        {
+            block_numbers_[&bb] = blocks_.size();
+            blocks_.push_back(&bb);
+
+            for (const Instruction& inst : bb)
+            {
+                value_numbers_[&inst] = values_.size();
+                values_.push_back(&inst);
+            }
+        }
     }
 
-    void FunctionControlFlowInfo::ComputeBackEdges(const llvm::Function* func)
+    FunctionControlFlowInfo::FunctionControlFlowInfo(const llvm::Function* func,
+                                                     const FunctionNumbering& numbering)
+        : func_(func), numbering_(numbering), wto_(func)
+    {
+        ComputeBackEdges();
+    }
+
+    void FunctionControlFlowInfo::ComputeBackEdges()
     {
         // collect backward control flow edges
         SmallVector<pair<const BasicBlock*, const BasicBlock*>, 8> buffer;
-        FindFunctionBackedges(*func, buffer);
+        FindFunctionBackedges(*func_, buffer);
 
-        this->backedges_ = set<ControlFlowEdge>(buffer.begin(), buffer.end());
+        backedge_sources_.resize(numbering_.NumBlocks());
+        for (const auto& [src, dst] : buffer)
+        {
+            backedge_sources_[numbering_.BlockNumber(dst)].push_back(numbering_.BlockNumber(src));
+        }
     }
 
-    void FunctionControlFlowInfo::ComputeExecAfterLookup(const llvm::Function* func)
+    void FunctionControlFlowInfo::ComputeExecAfterLookup() const
     {
-        unordered_map<const BasicBlock*, ExecAfterConditionMap> result;
-        unordered_set<const BasicBlock*> workset;
-        deque<const BasicBlock*> worklist;
+        int num_blocks = numbering_.NumBlocks();
 
-        for (const BasicBlock& bb : *func)
+        // reachable blocks in post order, followed by unreachable blocks, so that rows of
+        // successors are mostly complete when they are merged and only loops take more rounds
+        vector<const BasicBlock*> order(po_begin(func_), po_end(func_));
+        unordered_set<const BasicBlock*> ordered(order.begin(), order.end());
+        for (const BasicBlock& bb : *func_)
         {
-            auto& condition_map     = result[&bb];
-            bool has_single_succ_bb = succ_size(&bb) == 1;
-            for (const BasicBlock* succ_bb : successors(&bb))
+            if (ordered.find(&bb) == ordered.end())
             {
-                condition_map[succ_bb] =
-                    has_single_succ_bb ? ExecAfterCondition::Must : ExecAfterCondition::May;
+                order.push_back(&bb);
             }
-
-            workset.insert(&bb);
-            worklist.push_front(&bb);
         }
 
-        while (!worklist.empty())
+        // dst may execute after src if it's a successor, or may execute after a successor
+        BlockBitMatrix may_exec_after{num_blocks};
+        for (bool updated = true; updated;)
         {
-            const BasicBlock* this_bb = worklist.front();
-            workset.erase(this_bb);
-            worklist.pop_front();
-
-            unordered_map<const BasicBlock*, int> must_exec_after_counters;
-            for (const BasicBlock* succ_bb : successors(this_bb))
+            updated = false;
+            for (const BasicBlock* bb : order)
             {
-                for (const auto& [bb, condition] : result[succ_bb])
+                int index = numbering_.BlockNumber(bb);
+                for (const BasicBlock* succ_bb : successors(bb))
                 {
-                    assert(condition != ExecAfterCondition::Never);
-
-                    if (condition == ExecAfterCondition::Must)
-                    {
-                        must_exec_after_counters[bb] += 1;
-                    }
-                    else // condition == ExecAfterCondition::May
+                    int succ_index = numbering_.BlockNumber(succ_bb);
+                    if (!may_exec_after.Test(index, succ_index))
                     {
-                        must_exec_after_counters[bb] = 0;
+                        may_exec_after.Set(index, succ_index);
+                        updated = true;
                     }
+
+                    updated = may_exec_after.UnionRow(index, succ_index) || updated;
                 }
             }
+        }
 
-            bool updated                         = false;
-            ExecAfterConditionMap& condition_map = result[this_bb];
-            for (const auto& [bb, counter] : must_exec_after_counters)
+        // post-dominators of each block including itself, from the root of the tree down
+        // NOTE blocks of infinite loops are connected to the virtual exit by the tree
+        PostDominatorTree post_dom_tree{const_cast<Function&>(*func_)};
+        BlockBitMatrix post_dominators{num_blocks};
+        for (const DomTreeNode* node : depth_first(post_dom_tree.getRootNode()))
+        {
+            if (node->getBlock() == nullptr)
             {
-                ExecAfterCondition& conditon_val = condition_map[bb];
-                ExecAfterCondition new_condition = counter < succ_size(this_bb)
-                                                       ? ExecAfterCondition::May
-                                                       : ExecAfterCondition::Must;
-
-                if (conditon_val != new_condition)
-                {
-                    updated      = true;
-                    conditon_val = new_condition;
-                }
+                // virtual exit
+                continue;
             }
 
-            if (updated)
+            int index = numbering_.BlockNumber(node->getBlock());
+            if (const DomTreeNode* idom = node->getIDom(); idom != nullptr && idom->getBlock())
             {
-                for (const BasicBlock* pred_bb : predecessors(this_bb))
-                {
-                    if (workset.find(pred_bb) == workset.end())
-                    {
-                        workset.insert(pred_bb);
-                        worklist.push_back(pred_bb);
-                    }
-                }
+                post_dominators.AssignRow(index, post_dominators,
+                                          numbering_.BlockNumber(idom->getBlock()));
             }
-        }
-
-        this->exec_after_lookup_ = move(result);
-    }
 
-    void FunctionControlFlowInfo::ComputeInstructionIndexLookup(const llvm::Function* func)
-    {
-        int counter = 0;
+            post_dominators.Set(index, index);
+        }
 
-        for (const BasicBlock& bb : *func)
+        // dst must execute after src if it post-dominates all successors of src
+        BlockBitMatrix must_exec_after{num_blocks};
+        for (const BasicBlock& bb : *func_)
         {
-            for (const Instruction& inst : bb)
+            if (succ_empty(&bb))
             {
-                this->inst_index_lookup_[&inst] = counter++;
+                continue;
+            }
+
+            int index = numbering_.BlockNumber(&bb);
+            must_exec_after.AssignRow(index, may_exec_after, index);
+            for (const BasicBlock* succ_bb : successors(&bb))
+            {
+                must_exec_after.IntersectRow(index, post_dominators,
+                                             numbering_.BlockNumber(succ_bb));
             }
         }
+
+        this->may_exec_after_  = move(may_exec_after);
+        this->must_exec_after_ = move(must_exec_after);
     }
 
 } // namespace mh
\ No newline at end of file
@@ -0,0 +1,197 @@
+#include "datadep.h"
+#include "analysis.h"
+#include "memory.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/IR/CFG.h"
+#include <set>
+
+using namespace std;
+using namespace llvm;
+
+namespace mh
+{
+    DataDependencyCounts DataDependencyResult::Count() const
+    {
+        DataDependencyCounts counts;
+        for (const auto& [dep_pair, constraint] : edges)
+        {
+            if (isa<StoreInst>(dep_pair.second))
+            {
+                counts.num_raw_store += 1;
+            }
+            else if (isa<CallInst>(dep_pair.second))
+            {
+                counts.num_raw_call += 1;
+            }
+            else if (isa<Argument>(dep_pair.second) || isa<GlobalVariable>(dep_pair.second))
+            {
+                counts.num_raw_arg += 1;
+            }
+        }
+
+        return counts;
+    }
+
+    DataDependencyAnalysis::DataDependencyAnalysis(AnalysisContext& ctx)
+        : ctx_(ctx), numbering_(ctx.Numbering()),
+          order_index_(numbering_.NumBlocks(), FunctionNumbering::kNoNumber),
+          block_graphs_(numbering_.NumBlocks())
+    {
+        for (const BasicBlock* bb : ReversePostOrderTraversal<const Function*>(ctx.Func()))
+        {
+            order_index_[numbering_.BlockNumber(bb)] = order_.size();
+            order_.push_back(bb);
+        }
+
+        for (int i = 0; i < numbering_.NumBlocks(); ++i)
+        {
+            if (order_index_[i] == FunctionNumbering::kNoNumber)
+            {
+                order_index_[i] = order_.size();
+                order_.push_back(numbering_.Block(i));
+            }
+        }
+    }
+
+    DataDependencyAnalysis::~DataDependencyAnalysis()
+    {
+        if (MemoryAccounting::Enabled())
+        {
+            for (const ConstrainedDataDependencyGraph& graph : block_graphs_)
+            {
+                ctx_.AccountMemory(MemoryCategory::DataDependency, EstimateMemoryUsage(graph), 0);
+            }
+        }
+    }
+
+    const DataDependencyResult& DataDependencyAnalysis::Run()
+    {
+        // indices into order_, so that the first dirty block in reverse post order is taken first
+        set<int> dirty;
+        for (int i = 0; i < order_.size(); ++i)
+        {
+            dirty.insert(i);
+        }
+
+        while (!dirty.empty())
+        {
+            const BasicBlock* bb = order_[*dirty.begin()];
+            dirty.erase(dirty.begin());
+
+            if (AnalyzeBlock(bb))
+            {
+                for (const BasicBlock* succ_bb : successors(bb))
+                {
+                    dirty.insert(order_index_[numbering_.BlockNumber(succ_bb)]);
+                }
+            }
+        }
+
+        return result_;
+    }
+
+    bool DataDependencyAnalysis::AnalyzeBlock(const llvm::BasicBlock* bb)
+    {
+        int pred_index = 0;
+        ConstrainedDataDependencyGraph graph;
+        for (const BasicBlock* prev_bb : predecessors(bb))
+        {
+            if (pred_index == 0)
+            {
+                graph = block_graphs_[numbering_.BlockNumber(prev_bb)];
+            }
+            else
+            {
+                graph.Merge(ctx_.Solver(), block_graphs_[numbering_.BlockNumber(prev_bb)]);
+            }
+
+            pred_index += 1;
+        }
+
+        // initialize if no predecessor, i.e. first basic block
+        if (pred_index == 0)
+        {
+            const vector<const Value*>& inputs = ctx_.CurrentSummary()->inputs;
+            for (const Value* arg_i : inputs)
+            {
+                int ptr_level_i = GetPointerNestLevel(arg_i->getType());
+                for (int k = 0; k < ptr_level_i; ++k)
+                {
+                    graph[AbstractLocation::FromRuntimeMemory(arg_i, k)][arg_i] = Constraint{true};
+                }
+            }
+        }
+
+        for (const Instruction& inst : *bb)
+        {
+            if (isa<AllocaInst>(inst) || IsMallocCall(&inst))
+            {
+                auto loc_alloc          = AbstractLocation::FromAllocation(&inst);
+                graph[loc_alloc][&inst] = Constraint{true};
+            }
+            else if (auto store_inst = dyn_cast<StoreInst>(&inst))
+            {
+                for (const auto& [ptr, c_ptr] : LookupPointer(store_inst->getPointerOperand()))
+                {
+                    graph.OverwriteRelationEdge(ptr, store_inst, c_ptr);
+                }
+            }
+            else if (auto load_inst = dyn_cast<LoadInst>(&inst))
+            {
+                // find data flow
+                for (const auto& [ptr, c_ptr] : LookupPointer(load_inst->getPointerOperand()))
+                {
+                    for (const auto& [src_val, c_contrib] : graph[ptr])
+                    {
+                        Constraint c_dep = c_ptr && c_contrib;
+
+                        if (ctx_.Solver().TestSatisfiability(c_dep))
+                        {
+                            result_.edges[pair{load_inst, src_val}] = c_dep;
+                        }
+                    }
+                }
+            }
+            else if (auto call_inst = dyn_cast<CallInst>(&inst))
+            {
+                if (auto it = ctx_.update_hitory_.find(call_inst); it != ctx_.update_hitory_.end())
+                {
+                    for (const auto& [ptr, c_passin] : it->second)
+                    {
+                        graph.OverwriteRelationEdge(ptr, call_inst, c_passin.Weaken());
+                    }
+                }
+            }
+        }
+
+        auto& graph_cell = block_graphs_[numbering_.BlockNumber(bb)];
+
+        if (MemoryAccounting::Enabled())
+        {
+            ctx_.AccountMemory(MemoryCategory::DataDependency, EstimateMemoryUsage(graph_cell),
+                               EstimateMemoryUsage(graph));
+        }
+
+        // TODO: workaround, verify soundness of such trick
+        graph.UpdateCachedNumEdge();
+        bool updated = graph.CachedNumEdge() != graph_cell.CachedNumEdge() ||
+                       !graph.Equals(ctx_.Solver(), graph_cell);
+
+        graph_cell = move(graph);
+        return updated;
+    }
+
+    const PointToMap& DataDependencyAnalysis::LookupPointer(const llvm::Value* ptr) const
+    {
+        static const PointToMap empty;
+
+        const AbstractStore& store = ctx_.result_store_;
+        if (auto it = store.find(AbstractLocation::FromRegister(ctx_.TranslateAliasReg(ptr)));
+            it != store.end())
+        {
+            return it->second;
+        }
+
+        return empty;
+    }
+} // namespace mh
@@ -0,0 +1,352 @@
+#include "driver.h"
+#include "analysis.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+using namespace llvm;
+
+namespace mh
+{
+    namespace
+    {
+        using Task = function<void()>;
+
+        // deque of tasks owned by a worker
+        // the owner pushes and pops at the back, thieves steal from the front
+        class WorkerQueue
+        {
+        private:
+            mutex mutex_;
+            deque<Task> tasks_;
+
+        public:
+            void Push(Task task)
+            {
+                lock_guard<mutex> lock{mutex_};
+                tasks_.push_back(move(task));
+            }
+
+            bool Pop(Task& task)
+            {
+                lock_guard<mutex> lock{mutex_};
+                if (tasks_.empty())
+                {
+                    return false;
+                }
+
+                task = move(tasks_.back());
+                tasks_.pop_back();
+                return true;
+            }
+
+            bool Steal(Task& task)
+            {
+                lock_guard<mutex> lock{mutex_};
+                if (tasks_.empty())
+                {
+                    return false;
+                }
+
+                task = move(tasks_.front());
+                tasks_.pop_front();
+                return true;
+            }
+        };
+
+        // Work-stealing thread pool
+        // A worker waiting for tasks it submitted keeps running other tasks, so tasks can wait for
+        // nested tasks without blocking a thread
+        class WorkStealingPool
+        {
+        private:
+            vector<unique_ptr<WorkerQueue>> queues_;
+            vector<thread> workers_;
+
+            // number of tasks in queues
+            atomic<int> num_queued_ = 0;
+            atomic<bool> stopping_  = false;
+            atomic<int> next_queue_ = 0;
+
+            mutex idle_mutex_;
+            condition_variable idle_cv_;
+
+            // index of the worker running on this thread, -1 for threads outside of the pool
+            static thread_local int current_worker_;
+
+        public:
+            WorkStealingPool(int num_threads)
+            {
+                for (int i = 0; i < num_threads; ++i)
+                {
+                    queues_.push_back(make_unique<WorkerQueue>());
+                }
+
+                for (int i = 0; i < num_threads; ++i)
+                {
+                    workers_.emplace_back([this, i] {
+                        current_worker_ = i;
+                        WaitUntil([this] { return stopping_.load(); });
+                    });
+                }
+            }
+
+            ~WorkStealingPool()
+            {
+                stopping_ = true;
+                Notify();
+
+                for (thread& worker : workers_)
+                {
+                    worker.join();
+                }
+            }
+
+            int NumThreads() const noexcept { return workers_.size(); }
+
+            // submit to the queue of the current worker, or distribute tasks from outside
+            void Submit(Task task)
+            {
+                int index = current_worker_ >= 0 ? current_worker_
+                                                 : next_queue_++ % static_cast<int>(queues_.size());
+
+                queues_[index]->Push(move(task));
+                num_queued_ += 1;
+                Notify();
+            }
+
+            // block until `done` holds, running tasks meanwhile if called from a worker
+            void WaitUntil(const function<bool()>& done)
+            {
+                while (!done())
+                {
+                    if (current_worker_ >= 0 && RunTask(current_worker_))
+                    {
+                        continue;
+                    }
+
+                    unique_lock<mutex> lock{idle_mutex_};
+                    idle_cv_.wait(lock, [&] {
+                        return done() || (current_worker_ >= 0 && num_queued_ > 0);
+                    });
+                }
+            }
+
+            // wake up waiters to test their conditions
+            void Notify()
+            {
+                // lock so that a waiter can't miss the notification between its test and wait
+                {
+                    lock_guard<mutex> lock{idle_mutex_};
+                }
+
+                idle_cv_.notify_all();
+            }
+
+        private:
+            bool RunTask(int worker)
+            {
+                Task task;
+
+                bool found = queues_[worker]->Pop(task);
+                for (int i = 1; !found && i < queues_.size(); ++i)
+                {
+                    found = queues_[(worker + i) % queues_.size()]->Steal(task);
+                }
+
+                if (!found)
+                {
+                    return false;
+                }
+
+                num_queued_ -= 1;
+                task();
+
+                // waiters may be waiting for the completion
+                Notify();
+                return true;
+            }
+        };
+
+        thread_local int WorkStealingPool::current_worker_ = -1;
+    } // namespace
+
+    ParallelAnalysisDriver::ParallelAnalysisDriver(SummaryEnvironment* env, int num_threads)
+        : env_(env), num_threads_(num_threads)
+    {
+        if (num_threads_ <= 0)
+        {
+            num_threads_ = max(1u, thread::hardware_concurrency());
+        }
+    }
+
+    void ParallelAnalysisDriver::AddComponent(std::vector<const llvm::Function*> funcs,
+                                              bool recursive)
+    {
+        int index = components_.size();
+        for (const Function* func : funcs)
+        {
+            component_lookup_[func] = index;
+        }
+
+        Component component;
+        for (const Function* func : funcs)
+        {
+            // summaries are created here, so that workers only look up existing ones
+            const FunctionSummary& summary = env_->LookupSummary(func);
+
+            for (const Function* callee : summary.called_functions)
+            {
+                auto it = component_lookup_.find(callee);
+                if (it == component_lookup_.end() || it->second == index)
+                {
+                    // declarations, or recursion in the component
+                    continue;
+                }
+
+                vector<int>& callers = components_[it->second].callers;
+                if (callers.empty() || callers.back() != index)
+                {
+                    callers.push_back(index);
+                    component.num_callees += 1;
+                }
+            }
+        }
+
+        component.funcs     = move(funcs);
+        component.recursive = recursive;
+        components_.push_back(move(component));
+    }
+
+    void ParallelAnalysisDriver::Run(const std::function<bool()>& cancelled)
+    {
+        int num_components = components_.size();
+        if (num_components == 0)
+        {
+            return;
+        }
+
+        WorkStealingPool pool{num_threads_};
+
+        ParallelForFunction parallel_for = [&](int n, const function<void(int)>& body) {
+            atomic<int> num_pending = n;
+            for (int i = 0; i < n; ++i)
+            {
+                pool.Submit([&, i] {
+                    body(i);
+                    num_pending -= 1;
+                });
+            }
+
+            pool.WaitUntil([&] { return num_pending == 0; });
+        };
+
+        vector<atomic<int>> num_pending_callees(num_components);
+        atomic<int> num_remaining = num_components;
+
+        function<void(int)> analyze_component = [&](int index) {
+            const Component& component = components_[index];
+            // a cancelled component still releases its callers, so that they are skipped as well
+            bool skipped = cancelled && cancelled();
+            if (!skipped && component.recursive)
+            {
+                AnalyzeRecursiveComponent(*env_, component.funcs, parallel_for);
+            }
+            else if (!skipped)
+            {
+                for (const Function* func : component.funcs)
+                {
+                    AnalyzeFunction(*env_, func);
+                }
+            }
+
+            // summaries of the component are read by callers from now on
+            for (const Function* func : component.funcs)
+            {
+                env_->PublishSummary(env_->LookupSummary(func));
+            }
+
+            for (int caller : component.callers)
+            {
+                if (--num_pending_callees[caller] == 0)
+                {
+                    pool.Submit([&, caller] { analyze_component(caller); });
+                }
+            }
+
+            num_remaining -= 1;
+        };
+
+        for (int i = 0; i < num_components; ++i)
+        {
+            num_pending_callees[i] = components_[i].num_callees;
+        }
+
+        for (int i = 0; i < num_components; ++i)
+        {
+            if (components_[i].num_callees == 0)
+            {
+                pool.Submit([&, i] { analyze_component(i); });
+            }
+        }
+
+        pool.WaitUntil([&] { return num_remaining == 0; });
+    }
+
+    void AnalyzeCallGraphSCC(SummaryEnvironment& env, ParallelAnalysisDriver* driver,
+                             llvm::ArrayRef<llvm::CallGraphNode*> scc)
+    {
+        vector<const Function*> component;
+        bool recursive_component = scc.size() > 1;
+        for (const CallGraphNode* node : scc)
+        {
+            auto func = node->getFunction();
+            if (func == nullptr || func->isDeclaration())
+            {
+                continue;
+            }
+
+            // detect recursion
+            // TODO: use external flag as doesNotRecurse modifies the Function object
+            if (scc.size() == 1)
+            {
+                bool recurse = false;
+                for (auto rec : *node)
+                {
+                    if (rec.second == node)
+                    {
+                        recurse = true;
+                        break;
+                    }
+                }
+
+                if (!recurse)
+                {
+                    func->setDoesNotRecurse();
+                }
+
+                recursive_component = recurse;
+            }
+
+            // perform analysis
+            if (driver != nullptr)
+            {
+                component.push_back(func);
+            }
+            else
+            {
+                AnalyzeFunction(env, func);
+            }
+        }
+
+        if (!component.empty())
+        {
+            driver->AddComponent(move(component), recursive_component);
+        }
+    }
+} // namespace mh
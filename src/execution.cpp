@@ -17,6 +17,7 @@ namespace mh
         AbstractLocation loc = AbstractLocation::FromAllocation(reg);
         if (summary)
         {
+            ctx_->MarkSummaryLocation(loc);
             UpdateRegFile(reg, PointToMap{{loc, Constraint{true}.Weaken()}});
         }
         else
@@ -40,8 +41,7 @@ namespace mh
         const PointToMap& pt_map_1 = ctx_->LookupRegFile(val1);
         const PointToMap& pt_map_2 = ctx_->LookupRegFile(val2);
 
-        PointToMap& pt_map_update = ctx_->LookupRegFile(reg);
-        pt_map_update.clear();
+        PointToMap pt_map_update;
 
         for (const auto& [loc, constraint_1] : pt_map_1)
         {
@@ -62,6 +62,8 @@ namespace mh
                 pt_map_update.insert(pair{loc, constraint_2.Weaken()});
             }
         }
+
+        UpdateRegFile(reg, move(pt_map_update));
     }
 
     void AbstractExecution::DoAssignPhi(const llvm::Instruction* reg,
@@ -108,6 +110,9 @@ namespace mh
     AbstractExecution::ExtractStoreToCurrentContext(const FunctionSummary& called_summary,
                                                     const std::vector<const llvm::Value*>& inputs)
     {
+        // alias variables of the callee may not be created in this thread yet
+        SmtProvider::Current().ReserveAliasVariables(called_summary.inputs.size());
+
         z3::expr_vector zsrc{SmtProvider::Current().Context()};
         z3::expr_vector zdst_may{SmtProvider::Current().Context()};
         z3::expr_vector zdst_must{SmtProvider::Current().Context()};
@@ -177,6 +182,23 @@ namespace mh
         return result_store;
     }
 
+    // c1 && c2, without building new terms if either is literally true
+    static Constraint ConjoinConstraint(const Constraint& c1, const Constraint& c2)
+    {
+        if (c1.IsTopLiteral())
+        {
+            return c2;
+        }
+        else if (c2.IsTopLiteral())
+        {
+            return c1;
+        }
+        else
+        {
+            return c1 && c2;
+        }
+    }
+
     AbstractExecution::ArgParamMappingLookup
     AbstractExecution::ConstructArgParamMappingLookup(const FunctionSummary& called_summary,
                                                       const std::vector<const llvm::Value*>& inputs)
@@ -188,52 +210,52 @@ namespace mh
 
         // buffer of argument-space locations to be mapped
         // constraint should be an accumulation of constraint in the path from reg to loc
-        deque<pair<AbstractLocation, Constraint>> loc_buffer_a;
+        auto& loc_buffer_a = ctx_->deref_walk_buffer_;
         // buffer of pointed locations of current location under analysis
         // constraint should be an accumulation of constraint in the path from reg to loc
-        deque<pair<AbstractLocation, Constraint>> loc_pointed_buffer_a;
+        auto& loc_pointed_buffer_a = ctx_->deref_walk_pointed_buffer_;
 
-        for (int i = 0; i < called_summary.inputs.size(); ++i)
-        {
-            const Value* input_param = called_summary.inputs[i];
-            const Value* input_arg   = inputs[i];
+        const DerefChainTemplate& deref_chains = called_summary.deref_chains;
+        assert(deref_chains.NumInputs() == called_summary.inputs.size());
 
+        for (int i = 0; i < deref_chains.NumInputs(); ++i)
+        {
             // initialize buffer
             loc_buffer_a.clear();
-            loc_pointed_buffer_a.clear();
-            for (const auto& [loc_a, constraint] : ctx_->LookupRegFile(input_arg))
+            for (const auto& [loc_a, constraint] : ctx_->LookupRegFile(inputs[i]))
             {
                 loc_buffer_a.push_back(pair{loc_a, constraint});
             }
 
-            // bfs to construct mappings
-            int ptr_level = GetPointerNestLevel(input_param->getType());
-            for (int deref_level = 0; deref_level <= ptr_level; ++deref_level)
+            // walk along the dereference chain of the parameter to construct mappings
+            int chain_length = deref_chains.ChainLength(i);
+            for (int deref_level = 0; deref_level < chain_length; ++deref_level)
             {
-                AbstractLocation loc_p =
-                    AbstractLocation::FromRuntimeMemory(input_param, deref_level);
+                const AbstractLocation& loc_p = deref_chains.ChainLocation(i, deref_level);
+                PointToMap& pa_map            = loc_mapping_pa[loc_p];
+                bool last_level               = deref_level + 1 == chain_length;
 
-                assert(loc_pointed_buffer_a.empty());
-                while (!loc_buffer_a.empty())
+                loc_pointed_buffer_a.clear();
+                for (const auto& [loc_a, constraint] : loc_buffer_a)
                 {
-                    auto [loc_a, constraint] = move(loc_buffer_a.front());
-                    loc_buffer_a.pop_front();
-
-                    // collect pointed locations of loc_a
-                    if (auto it_pt_map_a = store_.find(loc_a); it_pt_map_a != store_.end())
+                    // collect pointed locations of loc_a, unless the chain ends here
+                    if (!last_level)
                     {
-                        for (const auto& [loc_pointed_a, pointed_constraint] : it_pt_map_a->second)
+                        if (auto it_pt_map_a = store_.find(loc_a); it_pt_map_a != store_.end())
                         {
-                            loc_pointed_buffer_a.push_back(
-                                pair{loc_pointed_a, constraint && pointed_constraint});
+                            for (const auto& [loc_pointed_a, pointed_constraint] :
+                                 it_pt_map_a->second)
+                            {
+                                loc_pointed_buffer_a.push_back(
+                                    pair{loc_pointed_a, ConjoinConstraint(constraint,
+                                                                          pointed_constraint)});
+                            }
                         }
                     }
 
                     // save mappings
-                    Constraint& c_pa = loc_mapping_pa[loc_p][loc_a];
-                    Constraint& c_ap = loc_mapping_ap[loc_a][loc_p];
-                    c_pa             = c_pa || constraint;
-                    c_ap             = c_ap || constraint;
+                    AddPointToEdge(pa_map, loc_a, constraint);
+                    AddPointToEdge(loc_mapping_ap[loc_a], loc_p, constraint);
                 }
 
                 // reuse buffer
@@ -257,11 +279,14 @@ namespace mh
         return ArgParamMappingLookup{.pa = move(loc_mapping_pa), .ap = move(loc_mapping_ap)};
     }
 
-    void AbstractExecution::MergeInvocationStore(const llvm::Instruction* reg,
-                                                 const FunctionSummary& called_summary,
-                                                 AbstractStore result_store,
-                                                 ArgParamMappingLookup loc_mapping)
+    std::vector<AbstractLocation>
+    AbstractExecution::MergeInvocationStore(const llvm::Instruction* reg,
+                                            const FunctionSummary& called_summary,
+                                            AbstractStore result_store,
+                                            ArgParamMappingLookup loc_mapping)
     {
+        vector<AbstractLocation> updated_locs;
+
         // [ (loc_a, loc_p, weaken_to_summary) ]
         deque<tuple<AbstractLocation, AbstractLocation, bool>> loc_import_worklist;
         unordered_set<AbstractLocation> loc_import_workset;
@@ -310,6 +335,12 @@ namespace mh
                     AbstractLocation new_loc = ctx_->RelabelLocation(loc_pointed_p, reg);
                     bool weaken_to_summary   = loc_pointed_p.CallPoint() == new_loc.CallPoint();
 
+                    if (weaken_to_summary || called_summary.summary_locs.find(loc_pointed_p) !=
+                                                 called_summary.summary_locs.end())
+                    {
+                        ctx_->MarkSummaryLocation(new_loc);
+                    }
+
                     Constraint c = c_mapping_ptr && c_point_to;
                     if (weaken_to_summary)
                     {
@@ -371,6 +402,7 @@ namespace mh
 
             // update point-to relations from loc_a
             MarkLocationUpdate(loc_a);
+            updated_locs.push_back(loc_a);
             store_[loc_a] = move(new_pt_map);
         }
 
@@ -405,8 +437,69 @@ namespace mh
 
             // update point-to relations from loc_a
             MarkLocationUpdate(loc_a);
+            updated_locs.push_back(loc_a);
             store_[loc_a] = move(new_pt_map);
         }
+
+        return updated_locs;
+    }
+
+    bool AbstractExecution::TestInvocationRecord(const InvocationRecord& record,
+                                                 const FunctionSummary& called_summary,
+                                                 const std::vector<const llvm::Value*>& inputs)
+    {
+        if (record.summary != &called_summary || record.summary_version != called_summary.version)
+        {
+            return false;
+        }
+
+        // constraints are usually rebuilt by merges in every visit, so fall back to equivalence
+        // test if they are not syntactically identical
+        auto equal_pt_map = [&](const PointToMap& pt_map_old, const PointToMap& pt_map_new) {
+            return IdenticalPointToMap(pt_map_old, pt_map_new) ||
+                   EqualPointToMap(ctx_->Solver(), pt_map_old, pt_map_new);
+        };
+
+        assert(record.input_pt_maps.size() == inputs.size());
+        for (size_t i = 0; i < inputs.size(); ++i)
+        {
+            if (!equal_pt_map(record.input_pt_maps[i], ctx_->LookupRegFile(inputs[i])))
+            {
+                return false;
+            }
+        }
+
+        // locations reachable from inputs are determined by the point-to maps compared so far,
+        // so the recorded slice covers all locations an instantiation would visit now
+        for (const auto& [loc, pt_map] : record.store_slice)
+        {
+            static const PointToMap empty_pt_map;
+
+            auto it = store_.find(loc);
+            if (!equal_pt_map(pt_map, it != store_.end() ? it->second : empty_pt_map))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void AbstractExecution::ReplayInvocationRecord(const llvm::Instruction* reg,
+                                                   const InvocationRecord& record)
+    {
+        ctx_->update_hitory_[reg] = record.update_history;
+
+        for (const auto& [loc, pt_map] : record.store_delta)
+        {
+            MarkLocationUpdate(loc);
+            store_[loc] = pt_map;
+        }
+
+        if (record.has_return)
+        {
+            UpdateRegFile(reg, record.return_pt_map);
+        }
     }
 
     // TODO: remove this
@@ -423,6 +516,15 @@ namespace mh
             return;
         }
 
+        assert(shared_store_ == nullptr && "memory is written in a MemoryUse block");
+        // replay the instantiation of the last visit if nothing it depends on is changed
+        InvocationRecord& record = ctx_->invocation_cache_[reg];
+        if (TestInvocationRecord(record, called_summary, inputs))
+        {
+            ReplayInvocationRecord(reg, record);
+            return;
+        }
+
         ctx_->update_hitory_[reg].clear();
 
         // step 1: rewrite constraint terms
@@ -446,9 +548,40 @@ namespace mh
         //          ai --> *ai --> ... --> **ai
         ArgParamMappingLookup loc_mapping = ConstructArgParamMappingLookup(called_summary, inputs);
 
+        // record inputs of this instantiation, i.e. all caller locations visited by the mapping
+        record.summary         = &called_summary;
+        record.summary_version = called_summary.version;
+        record.input_pt_maps.clear();
+        record.store_slice.clear();
+        for (const Value* input : inputs)
+        {
+            record.input_pt_maps.push_back(ctx_->LookupRegFile(input));
+        }
+        for (const auto& [loc_a, eq_map] : loc_mapping.ap)
+        {
+            auto it = store_.find(loc_a);
+            record.store_slice.push_back({loc_a, it != store_.end() ? it->second : PointToMap{}});
+        }
+
         // step 3: merge callee's heap into current execution
         //
-        MergeInvocationStore(reg, called_summary, move(result_store), move(loc_mapping));
+        vector<AbstractLocation> updated_locs =
+            MergeInvocationStore(reg, called_summary, move(result_store), move(loc_mapping));
+
+        // record effects of this instantiation
+        record.store_delta.clear();
+        for (const AbstractLocation& loc : updated_locs)
+        {
+            record.store_delta.push_back({loc, store_.at(loc)});
+        }
+        record.update_history = ctx_->update_hitory_[reg];
+        record.has_return     = false;
+        if (called_summary.return_inst != nullptr &&
+            called_summary.return_inst->getReturnValue() != nullptr)
+        {
+            record.has_return    = true;
+            record.return_pt_map = ctx_->LookupRegFile(reg);
+        }
     }
 
     void AbstractExecution::DoLoad(const llvm::Instruction* reg, const llvm::Value* reg_ptr)
@@ -457,10 +590,12 @@ namespace mh
         reg_ptr = ctx_->TranslateAliasReg(reg_ptr);
 
         PointToMap pt_map_reg;
+        const AbstractStore& store   = ReadStore();
         const PointToMap& pt_map_ptr = ctx_->LookupRegFile(reg_ptr);
         for (const auto& [ptr, ptr_constraint] : pt_map_ptr)
         {
-            if (auto it = store_.find(ptr); it != store_.end())
+            loaded_locs_.push_back(ptr);
+            if (auto it = store.find(ptr); it != store.end())
             {
                 for (const auto& [val, val_constraint] : it->second)
                 {
@@ -478,9 +613,29 @@ namespace mh
         reg_val = ctx_->TranslateAliasReg(reg_val);
         reg_ptr = ctx_->TranslateAliasReg(reg_ptr);
 
+        assert(shared_store_ == nullptr && "memory is written in a MemoryUse block");
+
         // find register to update
         const PointToMap& pt_map_val = ctx_->LookupRegFile(reg_val);
         const PointToMap& pt_map_ptr = ctx_->LookupRegFile(reg_ptr);
+
+        // strong update: the pointer must alias a single concrete location, so the old value is
+        // always overwritten and its edges can be dropped
+        if (pt_map_ptr.size() == 1)
+        {
+            const auto& [ptr, ptr_constraint] = *pt_map_ptr.begin();
+            if (!ctx_->IsSummaryLocation(ptr) &&
+                (ptr_constraint.IsTopLiteral() || ctx_->Solver().TestValidity(ptr_constraint)))
+            {
+                MarkLocationUpdate(ptr);
+
+                PointToMap& pt_map_ptr_deref = store_[ptr];
+                pt_map_ptr_deref             = pt_map_val;
+                return;
+            }
+        }
+
+        // weak update: the pointer may alias any of its targets
         for (const auto& [ptr, ptr_constraint] : pt_map_ptr)
         {
             MarkLocationUpdate(ptr);
@@ -501,34 +656,51 @@ namespace mh
         }
     }
 
-    bool AbstractExecution::TestStoreUpdate(const AbstractStore& store_old)
+    std::vector<AbstractLocation>
+    AbstractExecution::CollectUpdatedLocations(const AbstractStore& store_old,
+                                               const std::unordered_set<AbstractLocation>& pass_locs)
     {
-        if (reg_update_)
-        {
-            return true;
-        }
-
-        for (const auto& loc : important_loc_)
-        {
+        vector<AbstractLocation> result;
+        auto test_update = [&](const AbstractLocation& loc) {
             static PointToMap empty_pt_map;
 
-            auto it = store_old.find(loc);
+            auto it_new = store_.find(loc);
+            auto it_old = store_old.find(loc);
 
-            const PointToMap& pt_map_old = it != store_old.end() ? it->second : empty_pt_map;
-            if (!EqualPointToMap(ctx_->Solver(), store_.at(loc), pt_map_old))
+            const PointToMap& pt_map_new = it_new != store_.end() ? it_new->second : empty_pt_map;
+            const PointToMap& pt_map_old = it_old != store_old.end() ? it_old->second : empty_pt_map;
+            if (!IdenticalPointToMap(pt_map_new, pt_map_old) &&
+                !EqualPointToMap(ctx_->Solver(), pt_map_new, pt_map_old))
             {
-                return true;
+                result.push_back(loc);
             }
-        }
+        };
 
-        return false;
+        for (const auto& loc : important_loc_)
+        {
+            test_update(loc);
+        }
+        for (const auto& loc : pass_locs)
+        {
+            if (important_loc_.find(loc) == important_loc_.end())
+            {
+                test_update(loc);
+            }
+        }
 
-        // return !EqualAbstractStore(ctx_->Solver(), store_, store_old);
+        return result;
     }
 
     void AbstractExecution::UpdateRegFile(const llvm::Value* reg, PointToMap pt_map)
     {
-        bool update = ctx_->UpdateRegFile(reg, std::move(pt_map), reg_update_);
-        reg_update_ = reg_update_ || update;
+        if (widen_)
+        {
+            WidenPointToMap(ctx_->Solver(), ctx_->LookupRegFile(reg), pt_map);
+        }
+
+        if (ctx_->UpdateRegFile(reg, std::move(pt_map)))
+        {
+            updated_regs_.push_back(reg);
+        }
     }
 } // namespace mh
\ No newline at end of file
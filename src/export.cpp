@@ -0,0 +1,559 @@
+#include "export.h"
+#include "summary.h"
+#include "utils/byte-utils.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include <optional>
+#include <vector>
+
+using namespace std;
+using namespace llvm;
+using namespace mh::detail;
+
+namespace mh
+{
+    namespace
+    {
+        constexpr char kBinaryMagic[] = "HEXP";
+
+        // bump when records change in a way that breaks readers
+        constexpr uint64_t kExportFormatVersion = 1;
+
+        enum class RecordKind : uint8_t
+        {
+            Module,
+            Value,
+            CallPoint,
+            Summary,
+            RawDependency,
+        };
+
+        StringRef RecordKindName(RecordKind kind)
+        {
+            switch (kind)
+            {
+            case RecordKind::Module:
+                return "module";
+            case RecordKind::Value:
+                return "value";
+            case RecordKind::CallPoint:
+                return "call_point";
+            case RecordKind::Summary:
+                return "summary";
+            case RecordKind::RawDependency:
+                return "raw";
+            }
+
+            return "unknown";
+        }
+
+        enum class ValueKind : uint8_t
+        {
+            Global,
+            Function,
+            Argument,
+            Instruction,
+            Constant,
+        };
+
+        enum class ConstraintOp : uint8_t
+        {
+            False,
+            True,
+            Not,
+            And,
+            Or,
+            AliasEq,
+            SmtLib,
+        };
+
+        // short description of a constant, as constants have no names
+        string DescribeConstant(const Constant* constant)
+        {
+            if (isa<ConstantPointerNull>(constant))
+            {
+                return "null";
+            }
+            if (isa<UndefValue>(constant))
+            {
+                return "undef";
+            }
+            if (const ConstantInt* int_constant = dyn_cast<ConstantInt>(constant))
+            {
+                if (int_constant->getBitWidth() <= 64)
+                {
+                    return to_string(int_constant->getSExtValue());
+                }
+            }
+            if (const ConstantExpr* expr = dyn_cast<ConstantExpr>(constant))
+            {
+                return expr->getOpcodeName();
+            }
+
+            return "constant";
+        }
+    } // namespace
+
+    // builds a record in either format, keys are only written in JSON
+    // NOTE arrays are prefixed with their sizes in the binary format
+    class ResultExporter::RecordWriter
+    {
+    private:
+        ExportFormat format_;
+        RecordKind kind_;
+
+        string json_text_;
+        raw_string_ostream json_os_{json_text_};
+
+        // only created for JSON, as it requires a complete value on destruction
+        optional<json::OStream> json_;
+
+        ByteWriter bytes_;
+
+    public:
+        RecordWriter(ExportFormat format, RecordKind kind) : format_(format), kind_(kind)
+        {
+            if (format_ == ExportFormat::JsonLines)
+            {
+                json_.emplace(json_os_);
+                json_->objectBegin();
+                json_->attribute("type", RecordKindName(kind));
+            }
+        }
+
+        void Int(int64_t x)
+        {
+            if (format_ == ExportFormat::JsonLines)
+            {
+                json_->value(x);
+            }
+            else
+            {
+                // zigzag, so that small negative numbers stay short
+                bytes_.WriteVarint((static_cast<uint64_t>(x) << 1) ^ static_cast<uint64_t>(x >> 63));
+            }
+        }
+
+        void String(StringRef s)
+        {
+            if (format_ == ExportFormat::JsonLines)
+            {
+                json_->value(json::isUTF8(s) ? s.str() : json::fixUTF8(s));
+            }
+            else
+            {
+                bytes_.WriteString(s);
+            }
+        }
+
+        void BeginArray(size_t size)
+        {
+            if (format_ == ExportFormat::JsonLines)
+            {
+                json_->arrayBegin();
+            }
+            else
+            {
+                bytes_.WriteVarint(size);
+            }
+        }
+
+        void EndArray()
+        {
+            if (format_ == ExportFormat::JsonLines)
+            {
+                json_->arrayEnd();
+            }
+        }
+
+        void Key(StringRef key)
+        {
+            if (format_ == ExportFormat::JsonLines)
+            {
+                json_->attributeBegin(key);
+            }
+        }
+
+        void EndKey()
+        {
+            if (format_ == ExportFormat::JsonLines)
+            {
+                json_->attributeEnd();
+            }
+        }
+
+        void IntAttribute(StringRef key, int64_t x)
+        {
+            Key(key);
+            Int(x);
+            EndKey();
+        }
+
+        void StringAttribute(StringRef key, StringRef s)
+        {
+            Key(key);
+            String(s);
+            EndKey();
+        }
+
+        // [tag, definition id or -1, deref level or call point]
+        void Location(const AbstractLocation& loc, int64_t def_id)
+        {
+            BeginArray(3);
+            Int(static_cast<int64_t>(loc.Tag()));
+            Int(def_id);
+            Int(loc.PlaceholderId());
+            EndArray();
+        }
+
+        void Finish(raw_ostream& os)
+        {
+            if (format_ == ExportFormat::JsonLines)
+            {
+                json_->objectEnd();
+                os << json_os_.str() << '\n';
+            }
+            else
+            {
+                os << static_cast<char>(kind_);
+                ByteWriter length;
+                length.WriteVarint(bytes_.Buffer().size());
+                os << length.Buffer() << bytes_.Buffer();
+            }
+        }
+    };
+
+    // nodes of constraint terms of a record, shared subterms are added once
+    class ResultExporter::ConstraintTable
+    {
+    private:
+        struct Node
+        {
+            ConstraintOp op;
+            vector<int> operands;
+            string smtlib;
+        };
+
+        vector<Node> nodes_;
+        unordered_map<unsigned, int> node_lookup_;
+
+    public:
+        int Add(const z3::expr& e)
+        {
+            if (auto it = node_lookup_.find(e.id()); it != node_lookup_.end())
+            {
+                return it->second;
+            }
+
+            Node node;
+            if (e.is_true() || e.is_false())
+            {
+                node.op = e.is_true() ? ConstraintOp::True : ConstraintOp::False;
+            }
+            else if (e.is_not() || e.is_and() || e.is_or())
+            {
+                node.op = e.is_not() ? ConstraintOp::Not
+                          : e.is_and() ? ConstraintOp::And
+                                       : ConstraintOp::Or;
+                for (unsigned i = 0; i < e.num_args(); ++i)
+                {
+                    node.operands.push_back(Add(e.arg(i)));
+                }
+            }
+            else if (SmtProvider::IsAliasExpr(e))
+            {
+                node.op       = ConstraintOp::AliasEq;
+                node.operands = {SmtProvider::AliasVariableIndex(e.arg(0)),
+                                 SmtProvider::AliasVariableIndex(e.arg(1))};
+            }
+            else
+            {
+                node.op     = ConstraintOp::SmtLib;
+                node.smtlib = e.to_string();
+            }
+
+            int index = nodes_.size();
+            nodes_.push_back(move(node));
+            node_lookup_[e.id()] = index;
+            return index;
+        }
+
+        // (may, must) nodes of a constraint
+        pair<int, int> Add(const Constraint& c)
+        {
+            int may = Add(c.GetMayExpr());
+            return {may, c.HasSameMayMust() ? may : Add(c.GetMustExpr())};
+        }
+
+        void Write(RecordWriter& record) const
+        {
+            record.Key("constraints");
+            record.BeginArray(nodes_.size());
+            for (const Node& node : nodes_)
+            {
+                bool has_text = node.op == ConstraintOp::SmtLib;
+
+                record.BeginArray(1 + node.operands.size() + (has_text ? 1 : 0));
+                record.Int(static_cast<int64_t>(node.op));
+                for (int operand : node.operands)
+                {
+                    record.Int(operand);
+                }
+                if (has_text)
+                {
+                    record.String(node.smtlib);
+                }
+                record.EndArray();
+            }
+            record.EndArray();
+            record.EndKey();
+        }
+    };
+
+    ResultExporter::ResultExporter(std::unique_ptr<llvm::raw_ostream> os, ExportFormat format)
+        : os_(move(os)), format_(format)
+    {
+        if (format_ == ExportFormat::Binary)
+        {
+            ByteWriter header;
+            header.WriteBytes(StringRef{kBinaryMagic, 4});
+            header.WriteVarint(kExportFormatVersion);
+            *os_ << header.Buffer();
+        }
+    }
+
+    ResultExporter::~ResultExporter() { Flush(); }
+
+    std::unique_ptr<ResultExporter>
+    ResultExporter::Create(const std::string& path, ExportFormat format, std::string& error)
+    {
+        error_code ec;
+        auto os = make_unique<raw_fd_ostream>(
+            path, ec, format == ExportFormat::Binary ? sys::fs::OF_None : sys::fs::OF_Text);
+        if (ec)
+        {
+            error = ec.message();
+            return nullptr;
+        }
+
+        // records are small, larger writes save syscalls on big modules
+        os->SetBufferSize(1 << 20);
+        return make_unique<ResultExporter>(move(os), format);
+    }
+
+    void ResultExporter::BeginModule(const llvm::Module& module)
+    {
+        lock_guard<mutex> lock{mutex_};
+
+        value_ids_.clear();
+        written_call_points_.clear();
+        next_value_id_ = 0;
+
+        for (const GlobalVariable& global : module.globals())
+        {
+            value_ids_[&global] = ValueInfo{next_value_id_++};
+        }
+        for (const Function& func : module)
+        {
+            value_ids_[&func] = ValueInfo{next_value_id_++};
+            for (const Argument& arg : func.args())
+            {
+                value_ids_[&arg] = ValueInfo{next_value_id_++, static_cast<int>(arg.getArgNo())};
+            }
+
+            int index = 0;
+            for (const Instruction& inst : instructions(func))
+            {
+                value_ids_[&inst] = ValueInfo{next_value_id_++, index++};
+            }
+        }
+
+        RecordWriter record{format_, RecordKind::Module};
+        record.StringAttribute("name", module.getModuleIdentifier());
+        record.Finish(*os_);
+    }
+
+    void ResultExporter::ExportSummary(const SummaryEnvironment& env,
+                                       const FunctionSummary& summary)
+    {
+        lock_guard<mutex> lock{mutex_};
+
+        // constraints are numbered first, as the table precedes the store
+        ConstraintTable constraints;
+        vector<pair<int, int>> edge_constraints;
+        for (const auto& [loc, pt_map] : summary.store)
+        {
+            for (const auto& [target, c] : pt_map)
+            {
+                edge_constraints.push_back(constraints.Add(c));
+            }
+        }
+
+        // definitions are written before the record referring to them
+        auto refer_location = [&](const AbstractLocation& loc) {
+            if ((loc.Tag() == LocationTag::Alloc || loc.Tag() == LocationTag::Value) &&
+                loc.CallPoint() > 0)
+            {
+                WriteCallPoint(env, loc.CallPoint());
+            }
+
+            return loc.Definition() != nullptr ? static_cast<int64_t>(WriteValue(loc.Definition()))
+                                               : -1;
+        };
+
+        RecordWriter record{format_, RecordKind::Summary};
+        record.IntAttribute("function", WriteValue(summary.func));
+        constraints.Write(record);
+
+        int edge_index = 0;
+        record.Key("store");
+        record.BeginArray(summary.store.size());
+        for (const auto& [loc, pt_map] : summary.store)
+        {
+            record.BeginArray(2);
+            record.Location(loc, refer_location(loc));
+            record.BeginArray(pt_map.size());
+            for (const auto& [target, c] : pt_map)
+            {
+                auto [may, must] = edge_constraints[edge_index++];
+
+                record.BeginArray(3);
+                record.Location(target, refer_location(target));
+                record.Int(may);
+                record.Int(must);
+                record.EndArray();
+            }
+            record.EndArray();
+            record.EndArray();
+        }
+        record.EndArray();
+        record.EndKey();
+
+        record.Key("summary_locs");
+        record.BeginArray(summary.summary_locs.size());
+        for (const AbstractLocation& loc : summary.summary_locs)
+        {
+            record.Location(loc, refer_location(loc));
+        }
+        record.EndArray();
+        record.EndKey();
+
+        record.Finish(*os_);
+    }
+
+    void ResultExporter::ExportDataDependencies(const llvm::Function* func,
+                                                const DataDependencyMap& deps)
+    {
+        lock_guard<mutex> lock{mutex_};
+
+        ConstraintTable constraints;
+        vector<pair<int, int>> edge_constraints;
+        for (const auto& [dep_pair, c] : deps)
+        {
+            edge_constraints.push_back(constraints.Add(c));
+        }
+
+        RecordWriter record{format_, RecordKind::RawDependency};
+        record.IntAttribute("function", WriteValue(func));
+        constraints.Write(record);
+
+        int edge_index = 0;
+        record.Key("edges");
+        record.BeginArray(deps.size());
+        for (const auto& [dep_pair, c] : deps)
+        {
+            auto [may, must] = edge_constraints[edge_index++];
+
+            record.BeginArray(4);
+            record.Int(WriteValue(dep_pair.first));
+            record.Int(WriteValue(dep_pair.second));
+            record.Int(may);
+            record.Int(must);
+            record.EndArray();
+        }
+        record.EndArray();
+        record.EndKey();
+
+        record.Finish(*os_);
+    }
+
+    void ResultExporter::Flush()
+    {
+        lock_guard<mutex> lock{mutex_};
+        os_->flush();
+    }
+
+    uint64_t ResultExporter::WriteValue(const llvm::Value* val)
+    {
+        auto [it, inserted] = value_ids_.try_emplace(val, ValueInfo{next_value_id_});
+        if (inserted)
+        {
+            // constants are not numbered with the module
+            next_value_id_ += 1;
+        }
+
+        ValueInfo& info = it->second;
+        if (info.written)
+        {
+            return info.id;
+        }
+        info.written = true;
+
+        // the function of an argument or instruction is defined first
+        uint64_t func_id = 0;
+        if (const Argument* arg = dyn_cast<Argument>(val))
+        {
+            func_id = WriteValue(arg->getParent());
+        }
+        else if (const Instruction* inst = dyn_cast<Instruction>(val))
+        {
+            func_id = WriteValue(inst->getFunction());
+        }
+
+        RecordWriter record{format_, RecordKind::Value};
+        record.IntAttribute("id", info.id);
+        if (isa<Function>(val) || isa<GlobalValue>(val))
+        {
+            ValueKind kind = isa<Function>(val) ? ValueKind::Function : ValueKind::Global;
+            record.IntAttribute("kind", static_cast<int64_t>(kind));
+            record.StringAttribute("name", val->getName());
+        }
+        else if (isa<Argument>(val) || isa<Instruction>(val))
+        {
+            ValueKind kind = isa<Argument>(val) ? ValueKind::Argument : ValueKind::Instruction;
+            record.IntAttribute("kind", static_cast<int64_t>(kind));
+            record.IntAttribute("function", func_id);
+            record.IntAttribute("index", info.index);
+        }
+        else
+        {
+            record.IntAttribute("kind", static_cast<int64_t>(ValueKind::Constant));
+            record.StringAttribute("name", isa<Constant>(val)
+                                               ? DescribeConstant(cast<Constant>(val))
+                                               : string{"unknown"});
+        }
+        record.Finish(*os_);
+
+        return info.id;
+    }
+
+    void ResultExporter::WriteCallPoint(const SummaryEnvironment& env, int call_point)
+    {
+        if (call_point == 0 || !written_call_points_.insert(call_point).second)
+        {
+            return;
+        }
+
+        CallPointData data = env.LookupCallPoint(call_point);
+        WriteCallPoint(env, data.prev_call_point);
+        uint64_t inst_id = WriteValue(data.inst);
+
+        RecordWriter record{format_, RecordKind::CallPoint};
+        record.IntAttribute("id", call_point);
+        record.IntAttribute("inst", inst_id);
+        record.IntAttribute("prev", data.prev_call_point);
+        record.Finish(*os_);
+    }
+} // namespace mh
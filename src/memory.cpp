@@ -0,0 +1,91 @@
+#include "memory.h"
+
+using namespace std;
+
+namespace mh
+{
+    namespace
+    {
+        string_view MemoryCategoryName(MemoryCategory category)
+        {
+            switch (category)
+            {
+            case MemoryCategory::ExecStore:
+                return "exec-store";
+            case MemoryCategory::RegFile:
+                return "regfile";
+            case MemoryCategory::Summary:
+                return "summary";
+            case MemoryCategory::SmtContext:
+                return "z3-context";
+            case MemoryCategory::DataDependency:
+                return "data-dependency";
+            case MemoryCategory::CallPoint:
+                return "call-point";
+            }
+
+            return "unknown";
+        }
+
+        string FormatBytes(size_t bytes)
+        {
+            if (bytes >= (1ull << 30))
+            {
+                return fmt::format("{:.2f} GB", bytes / double(1ull << 30));
+            }
+            else if (bytes >= (1ull << 20))
+            {
+                return fmt::format("{:.2f} MB", bytes / double(1ull << 20));
+            }
+            else if (bytes >= (1ull << 10))
+            {
+                return fmt::format("{:.2f} KB", bytes / double(1ull << 10));
+            }
+            else
+            {
+                return fmt::format("{} B", bytes);
+            }
+        }
+    } // namespace
+
+    void MemoryUsage::Report(std::string_view title) const
+    {
+        fmt::print("[Memory] {}\n", title);
+        for (int i = 0; i < kNumMemoryCategory; ++i)
+        {
+            auto category = static_cast<MemoryCategory>(i);
+            if (Peak(category) == 0)
+            {
+                // category not involved
+                continue;
+            }
+
+            fmt::print("  {:<16} live = {:>10}, peak = {:>10}\n", MemoryCategoryName(category),
+                       FormatBytes(Live(category)), FormatBytes(Peak(category)));
+        }
+    }
+
+    void MemoryAccounting::SampleSmtContext()
+    {
+        MemoryUsage& usage = Current();
+
+        size_t z3_bytes = Z3_get_estimated_alloc_size();
+        usage.Reallocate(MemoryCategory::SmtContext, usage.Live(MemoryCategory::SmtContext),
+                         z3_bytes);
+    }
+
+    size_t EstimateMemoryUsage(const ConstrainedDataDependencyGraph& graph) noexcept
+    {
+        using EdgeCollection = ConstrainedDataDependencyGraph::EdgeCollection;
+
+        // no access to buckets of the graph, count nodes only
+        size_t result = graph.size() * (sizeof(void*) * 2 + sizeof(size_t) +
+                                        sizeof(pair<const AbstractLocation, EdgeCollection>));
+        for (const auto& [loc, edges] : graph)
+        {
+            result += EstimateHashMapMemory(edges.Container());
+        }
+
+        return result;
+    }
+} // namespace mh
@@ -0,0 +1,143 @@
+#include "memoryssa.h"
+#include "utils.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Instructions.h"
+#include <vector>
+
+using namespace std;
+using namespace llvm;
+
+namespace mh
+{
+    BlockMemorySSA::BlockMemorySSA(const llvm::Function* func, const FunctionNumbering& numbering)
+    {
+        constexpr int kNoOwner = FunctionNumbering::kNoNumber;
+
+        // MemoryDef and MemoryPhi blocks own their stores
+        int num_blocks = numbering.NumBlocks();
+        store_owner_.assign(num_blocks, kNoOwner);
+        for (int i = 0; i < num_blocks; ++i)
+        {
+            const BasicBlock* bb = numbering.Block(i);
+            if (bb == &func->getEntryBlock() || IsMemoryDefBlock(bb) ||
+                bb->getSinglePredecessor() == nullptr)
+            {
+                store_owner_[i] = i;
+            }
+        }
+
+        // resolve MemoryUse blocks along single predecessor chains, marking blocks on the chain
+        // with the block being resolved
+        vector<int> visited_by(num_blocks, kNoOwner);
+        for (int i = 0; i < num_blocks; ++i)
+        {
+            if (store_owner_[i] != kNoOwner)
+            {
+                continue;
+            }
+
+            int owner = i;
+            while (store_owner_[owner] == kNoOwner)
+            {
+                if (visited_by[owner] == i)
+                {
+                    // a cycle of unreachable blocks, let the block own its store
+                    owner               = i;
+                    store_owner_[owner] = owner;
+                    break;
+                }
+
+                visited_by[owner] = i;
+                owner = numbering.BlockNumber(numbering.Block(owner)->getSinglePredecessor());
+            }
+
+            store_owner_[i] = store_owner_[owner];
+        }
+    }
+
+    BlockDefUseIndex::BlockDefUseIndex(const FunctionNumbering& numbering,
+                                       const BlockMemorySSA* memory_ssa)
+        : reg_users_(numbering.NumValues()), store_users_(numbering.NumBlocks())
+    {
+        auto add_user = [](BlockList& users, const BasicBlock* bb) {
+            if (find(users.begin(), users.end(), bb) == users.end())
+            {
+                users.push_back(bb);
+            }
+        };
+
+        for (int i = 0; i < numbering.NumBlocks(); ++i)
+        {
+            const BasicBlock* bb = numbering.Block(i);
+
+            // register uses, including registers aliased by cast/ptr operations
+            bool has_load = false;
+            for (const Instruction& inst : *bb)
+            {
+                has_load = has_load || isa<LoadInst>(inst);
+
+                for (const Value* val : inst.operands())
+                {
+                    while (isa<Instruction>(val))
+                    {
+                        add_user(reg_users_[numbering.ValueNumber(val)], bb);
+
+                        if (!isa<BitCastInst>(val) && !isa<GetElementPtrInst>(val))
+                        {
+                            break;
+                        }
+
+                        val = cast<Instruction>(val)->getOperand(0);
+                    }
+                }
+            }
+
+            // store uses
+            if (memory_ssa != nullptr && memory_ssa->IsMemoryUse(i))
+            {
+                if (has_load)
+                {
+                    add_user(store_users_[memory_ssa->LookupStoreOwner(i)], bb);
+                }
+            }
+            else
+            {
+                for (const BasicBlock* pred_bb : predecessors(bb))
+                {
+                    int pred  = numbering.BlockNumber(pred_bb);
+                    int owner = memory_ssa != nullptr ? memory_ssa->LookupStoreOwner(pred) : pred;
+                    add_user(store_users_[owner], bb);
+                }
+            }
+        }
+    }
+
+    bool BlockMemorySSA::IsMemoryDefBlock(const llvm::BasicBlock* bb)
+    {
+        for (const Instruction& inst : *bb)
+        {
+            if (isa<StoreInst>(inst))
+            {
+                return true;
+            }
+
+#ifdef HEAP_ANALYSIS_POINTS_TO_DETAIL
+            if (isa<AllocaInst>(inst) || IsMallocCall(&inst))
+            {
+                return true;
+            }
+#endif
+
+            if (auto call_inst = dyn_cast<CallInst>(&inst); call_inst != nullptr)
+            {
+                const Function* callee = call_inst->getCalledFunction();
+                if (callee != nullptr && !callee->isDeclaration() && !IsMallocCall(call_inst))
+                {
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+} // namespace mh
@@ -1,4 +1,8 @@
 #include "analysis.h"
+#include "cache.h"
+#include "driver.h"
+#include "export.h"
+#include "memory.h"
 #include "utils.h"
 
 #include "llvm/Pass.h"
@@ -7,6 +11,8 @@
 #include "llvm/Analysis/CFG.h"
 #include "llvm/Analysis/CallGraph.h"
 #include "llvm/Analysis/CallGraphSCCPass.h"
+#include <atomic>
+#include <memory>
 #include <string>
 #include <stack>
 #include <unordered_set>
@@ -16,10 +22,6 @@ using namespace mh;
 using namespace std;
 using namespace llvm;
 
-int GLOBAL_NUM_RAW_STORE = 0;
-int GLOBAL_NUM_RAW_CALL  = 0;
-int GLOBAL_NUM_RAW_ARG   = 0;
-
 namespace
 {
     class HeapAnalysis : public CallGraphSCCPass
@@ -27,6 +29,11 @@ namespace
     private:
         SummaryEnvironment env;
 
+        // if not null, SCCs are collected and analyzed in parallel on finalization
+        std::unique_ptr<ParallelAnalysisDriver> driver;
+
+        std::unique_ptr<ResultExporter> exporter;
+
         using time_point = chrono::high_resolution_clock::time_point;
         time_point t_start;
         time_point t_stop;
@@ -38,11 +45,46 @@ namespace
         bool doInitialization(CallGraph& M) override
         {
             t_start = chrono::high_resolution_clock::now();
+
+            if (!AnalysisOptions::Current().summary_cache_dir.empty())
+            {
+                env.EnableSummaryCache(AnalysisOptions::Current().summary_cache_dir);
+            }
+
+            if (const string& path = AnalysisOptions::Current().export_file; !path.empty())
+            {
+                string error;
+                exporter =
+                    ResultExporter::Create(path, AnalysisOptions::Current().export_format, error);
+                if (exporter == nullptr)
+                {
+                    report_fatal_error(Twine{fmt::format("can't open {}: {}", path, error)});
+                }
+
+                exporter->BeginModule(M.getModule());
+                env.SetExporter(exporter.get());
+            }
+
+            if (AnalysisOptions::Current().num_threads != 1)
+            {
+                driver = make_unique<ParallelAnalysisDriver>(&env,
+                                                            AnalysisOptions::Current().num_threads);
+            }
             return false;
         }
 
         bool doFinalization(CallGraph& M) override
         {
+            if (driver != nullptr)
+            {
+                driver->Run();
+            }
+
+            if (exporter != nullptr)
+            {
+                exporter->Flush();
+            }
+
             t_stop = chrono::high_resolution_clock::now();
 
             using FpMilliseconds = std::chrono::duration<float, std::chrono::milliseconds::period>;
@@ -65,42 +107,25 @@ namespace
             }
 
             fmt::print("Total Run Time: {} {}\n", dur, unit);
+
+            if (const SummaryCache* cache = env.Cache())
+            {
+                fmt::print("Summary Cache: {} hits, {} misses, {} unchanged\n", cache->NumHits(),
+                           cache->NumMisses(), cache->NumUnchanged());
+            }
+
+            if (MemoryAccounting::Enabled())
+            {
+                MemoryAccounting::SampleSmtContext();
+                MemoryAccounting::Current().Report("total");
+            }
             return false;
         }
 
         bool runOnSCC(CallGraphSCC& SCC) override
         {
-            for (const CallGraphNode* node : SCC)
-            {
-                auto func = node->getFunction();
-                if (func == nullptr || func->isDeclaration())
-                {
-                    continue;
-                }
-
-                // detect recursion
-                // TODO: use external flag as doesNotRecurse modifies the Function object
-                if (SCC.size() == 1)
-                {
-                    bool recurse = false;
-                    for (auto rec : *node)
-                    {
-                        if (rec.second == node)
-                        {
-                            recurse = true;
-                            break;
-                        }
-                    }
-
-                    if (!recurse)
-                    {
-                        func->setDoesNotRecurse();
-                    }
-                }
-
-                // perform analysis
-                AnalyzeFunction(env, func);
-            }
+            vector<CallGraphNode*> nodes{SCC.begin(), SCC.end()};
+            AnalyzeCallGraphSCC(env, driver.get(), nodes);
 
             return false;
         }
@@ -0,0 +1,91 @@
+#include "options.h"
+#include "llvm/Support/CommandLine.h"
+
+using namespace llvm;
+
+namespace mh
+{
+    namespace
+    {
+        cl::OptionCategory category{"Heap Analysis Options"};
+
+        cl::opt<bool, true> report_memory{
+            "heap-analysis-report-memory",
+            cl::desc("Report estimated memory usage per function and per analysis subsystem"),
+            cl::location(AnalysisOptions::Current().report_memory), cl::cat(category)};
+
+        cl::opt<bool, true> sparse_store{
+            "heap-analysis-sparse-store",
+            cl::desc("Propagate abstract stores along memory definitions only (default = on)"),
+            cl::location(AnalysisOptions::Current().sparse_store), cl::init(true),
+            cl::cat(category)};
+
+        cl::opt<int, true> widening_delay{
+            "heap-analysis-widening-delay",
+            cl::desc("Number of analyses of a loop head before widening its updates (0 = never)"),
+            cl::location(AnalysisOptions::Current().widening_delay), cl::init(0),
+            cl::cat(category)};
+
+        cl::opt<int, true> max_block_visits{
+            "heap-analysis-max-block-visits",
+            cl::desc("Block visits per analysis of a function before all updates are widened "
+                     "(0 = unlimited)"),
+            cl::location(AnalysisOptions::Current().max_block_visits), cl::init(0),
+            cl::cat(category)};
+
+        cl::opt<int, true> max_function_time_ms{
+            "heap-analysis-max-function-time",
+            cl::desc("Milliseconds per analysis of a function before all updates are widened "
+                     "(0 = unlimited)"),
+            cl::location(AnalysisOptions::Current().max_function_time_ms), cl::init(0),
+            cl::cat(category)};
+
+        cl::opt<int64_t, true> max_solver_queries{
+            "heap-analysis-max-solver-queries",
+            cl::desc("Solver queries per analysis of a function before all updates are widened "
+                     "(0 = unlimited)"),
+            cl::location(AnalysisOptions::Current().max_solver_queries), cl::init(0),
+            cl::cat(category)};
+
+        cl::opt<int, true> max_store_locations{
+            "heap-analysis-max-store-locations",
+            cl::desc("Locations in the store after a block before all updates of the analysis "
+                     "are widened (0 = unlimited)"),
+            cl::location(AnalysisOptions::Current().max_store_locations), cl::init(0),
+            cl::cat(category)};
+
+        cl::opt<int, true> num_threads{
+            "heap-analysis-threads",
+            cl::desc("Number of threads analyzing call graph SCCs (default = 1, 0 = all cores)"),
+            cl::location(AnalysisOptions::Current().num_threads), cl::init(1), cl::cat(category)};
+
+        cl::opt<std::string, true> summary_cache_dir{
+            "heap-analysis-cache-dir",
+            cl::desc("Directory to load and save converged function summaries across runs"),
+            cl::value_desc("directory"), cl::location(AnalysisOptions::Current().summary_cache_dir),
+            cl::cat(category)};
+
+        cl::opt<std::string, true> export_file{
+            "heap-analysis-export",
+            cl::desc("File to stream converged summaries and RAW dependencies into"),
+            cl::value_desc("filename"), cl::location(AnalysisOptions::Current().export_file),
+            cl::cat(category)};
+
+        cl::opt<ExportFormat, true> export_format{
+            "heap-analysis-export-format", cl::desc("Format of -heap-analysis-export"),
+            cl::values(clEnumValN(ExportFormat::JsonLines, "jsonl", "JSON Lines (default)"),
+                       clEnumValN(ExportFormat::Binary, "binary", "compact binary records")),
+            cl::location(AnalysisOptions::Current().export_format),
+            cl::init(ExportFormat::JsonLines), cl::cat(category)};
+
+        cl::opt<bool, true> data_dependency{
+            "heap-analysis-data-dep",
+            cl::desc("Compute RAW dependencies of converged functions (always on in debug mode)"),
+            cl::location(AnalysisOptions::Current().data_dependency), cl::cat(category)};
+
+        cl::opt<bool, true> evict_summaries{
+            "heap-analysis-evict-summaries",
+            cl::desc("Release stores of summaries once all their callers converged"),
+            cl::location(AnalysisOptions::Current().evict_summaries), cl::cat(category)};
+    } // namespace
+} // namespace mh
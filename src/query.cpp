@@ -0,0 +1,184 @@
+#include "query.h"
+#include "llvm/IR/CFG.h"
+
+using namespace std;
+using namespace llvm;
+
+namespace mh
+{
+    namespace
+    {
+        // block defining an argument or instruction, null for other values
+        const BasicBlock* LookupDefiningBlock(const Value* val)
+        {
+            if (const Argument* arg = dyn_cast<Argument>(val))
+            {
+                const Function* func = arg->getParent();
+                return func->isDeclaration() ? nullptr : &func->getEntryBlock();
+            }
+            else if (const Instruction* inst = dyn_cast<Instruction>(val))
+            {
+                return inst->getParent();
+            }
+
+            return nullptr;
+        }
+    } // namespace
+
+    QueryEngine::QueryEngine(SummaryEnvironment& env) : env_(env) {}
+
+    QueryEngine::~QueryEngine() = default;
+
+    PointToMap QueryEngine::PointsTo(const llvm::Value* val)
+    {
+        const BasicBlock* bb = LookupDefiningBlock(val);
+        if (bb == nullptr)
+        {
+            return {};
+        }
+
+        FunctionState& state = AnalyzeUpTo(bb->getParent(), {bb});
+        return LookupPointToMap(state, val);
+    }
+
+    bool QueryEngine::MayAlias(const llvm::Value* a, const llvm::Value* b)
+    {
+        const BasicBlock* bb_a = LookupDefiningBlock(a);
+        const BasicBlock* bb_b = LookupDefiningBlock(b);
+        if (bb_a == nullptr && bb_b == nullptr)
+        {
+            // globals and constants are distinct objects
+            return a == b;
+        }
+
+        if (bb_a != nullptr && bb_b != nullptr && bb_a->getParent() != bb_b->getParent())
+        {
+            return true;
+        }
+
+        // a global or a constant is compared as a register of the function of the other value
+        vector<const BasicBlock*> targets;
+        for (const BasicBlock* bb : {bb_a, bb_b})
+        {
+            if (bb != nullptr)
+            {
+                targets.push_back(bb);
+            }
+        }
+
+        const Function* func = targets.front()->getParent();
+        FunctionState& state = AnalyzeUpTo(func, move(targets));
+
+        PointToMap pt_map_a = LookupPointToMap(state, a);
+        PointToMap pt_map_b = LookupPointToMap(state, b);
+        for (const auto& [loc, c_a] : pt_map_a)
+        {
+            if (auto it = pt_map_b.find(loc);
+                it != pt_map_b.end() && state.ctx->Solver().TestSatisfiability(c_a && it->second))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    std::vector<std::pair<const llvm::Value*, Constraint>>
+    QueryEngine::RawDeps(const llvm::LoadInst* load)
+    {
+        const Function* func = load->getFunction();
+
+        vector<const BasicBlock*> targets;
+        for (const BasicBlock& bb : *func)
+        {
+            targets.push_back(&bb);
+        }
+
+        FunctionState& state = AnalyzeUpTo(func, move(targets));
+        if (!state.data_dep)
+        {
+            state.ctx->BuildResultStore();
+            state.data_dep = DataDependencyAnalysis{*state.ctx}.Run();
+        }
+
+        vector<pair<const Value*, Constraint>> result;
+        const DataDependencyMap& edges = state.data_dep->edges;
+        for (auto it = edges.lower_bound(pair{load, nullptr});
+             it != edges.end() && it->first.first == load; ++it)
+        {
+            result.push_back(pair{it->first.second, it->second});
+        }
+
+        return result;
+    }
+
+    QueryEngine::FunctionState& QueryEngine::AnalyzeUpTo(const llvm::Function* func,
+                                                         vector<const BasicBlock*> targets)
+    {
+        FunctionState& state = functions_[func];
+        if (state.ctx == nullptr)
+        {
+            state.ctx = make_unique<AnalysisContext>(&env_, &env_.LookupSummary(func));
+        }
+
+        // blocks reaching the targets, the scope stays closed under predecessors
+        unordered_set<const BasicBlock*> dirty;
+        while (!targets.empty())
+        {
+            const BasicBlock* bb = targets.back();
+            targets.pop_back();
+
+            if (!state.scope.insert(bb).second)
+            {
+                continue;
+            }
+
+            dirty.insert(bb);
+            for (const BasicBlock* pred_bb : predecessors(bb))
+            {
+                targets.push_back(pred_bb);
+            }
+        }
+
+        if (dirty.empty())
+        {
+            return state;
+        }
+
+        for (const BasicBlock* bb : dirty)
+        {
+            for (const Instruction& inst : *bb)
+            {
+                if (auto call_inst = dyn_cast<CallInst>(&inst))
+                {
+                    const Function* callee = call_inst->getCalledFunction();
+                    if (callee != nullptr && !callee->isDeclaration())
+                    {
+                        AnalyzeFunction(env_, callee);
+                    }
+                }
+            }
+        }
+
+        AnalyzeFunctionBlocks(*state.ctx, move(dirty), &state.scope);
+        return state;
+    }
+
+    PointToMap QueryEngine::LookupPointToMap(FunctionState& state, const llvm::Value* val)
+    {
+        AnalysisContext& ctx = *state.ctx;
+        const Value* reg     = ctx.TranslateAliasReg(val);
+
+        // registers are moved into the result store once it's built
+        if (state.data_dep)
+        {
+            const AbstractStore& store = ctx.ExportResultStore();
+            if (auto it = store.find(AbstractLocation::FromRegister(reg)); it != store.end())
+            {
+                return it->second;
+            }
+        }
+
+        return ctx.LookupRegFile(reg);
+    }
+} // namespace mh
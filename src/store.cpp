@@ -1,4 +1,5 @@
 #include "store.h"
+#include <unordered_set>
 #include <utility>
 
 using namespace std;
@@ -49,6 +50,67 @@ namespace mh
         return EqualEdgeConstraintMap(solver, pt_map_old, pt_map_new);
     }
 
+    bool IdenticalPointToMap(const PointToMap& pt_map_1, const PointToMap& pt_map_2)
+    {
+        if (pt_map_1.size() != pt_map_2.size())
+        {
+            return false;
+        }
+
+        for (const auto& [target_loc, c1] : pt_map_1)
+        {
+            auto it = pt_map_2.find(target_loc);
+            if (it == pt_map_2.end() || !c1.IsIdentical(it->second))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    AbstractStore TranslateStore(const AbstractStore& store, z3::context& ctx)
+    {
+        AbstractStore result;
+        for (const auto& [loc, pt_map] : store)
+        {
+            PointToMap& pt_map_result = result[loc];
+            for (const auto& [target_loc, c] : pt_map)
+            {
+                pt_map_result.insert(pair{target_loc, c.Translate(ctx)});
+            }
+        }
+
+        return result;
+    }
+
+    void WidenPointToMap(ConstraintSolver& solver, const PointToMap& pt_map_old,
+                         PointToMap& pt_map_new)
+    {
+        for (auto& [target_loc, c_new] : pt_map_new)
+        {
+            auto it = pt_map_old.find(target_loc);
+            if (it != pt_map_old.end() &&
+                (c_new.IsIdentical(it->second) || solver.TestEquivalence(c_new, it->second)))
+            {
+                // keep terms of the old constraint so later comparisons are syntactic
+                c_new = it->second;
+            }
+            else
+            {
+                c_new = Constraint{true}.Weaken();
+            }
+        }
+
+        for (const auto& [target_loc, c_old] : pt_map_old)
+        {
+            if (pt_map_new.find(target_loc) == pt_map_new.end())
+            {
+                pt_map_new.insert(pair{target_loc, Constraint{true}.Weaken()});
+            }
+        }
+    }
+
     bool EqualAbstractStore(ConstraintSolver& solver, const AbstractStore& s1,
                             const AbstractStore& s2)
     {
@@ -204,6 +266,43 @@ namespace mh
         }
     }
 
+    AbstractStore ExtractReachableStore(const AbstractStore& store,
+                                        const std::vector<AbstractLocation>& roots)
+    {
+        unordered_set<AbstractLocation> visited{roots.begin(), roots.end()};
+        vector<AbstractLocation> worklist{visited.begin(), visited.end()};
+        vector<AbstractStore::const_iterator> reachable;
+        while (!worklist.empty())
+        {
+            auto it = store.find(worklist.back());
+            worklist.pop_back();
+
+            if (it == store.end() || it->second.empty())
+            {
+                continue;
+            }
+
+            reachable.push_back(it);
+            for (const auto& [target_loc, c] : it->second)
+            {
+                if (visited.insert(target_loc).second)
+                {
+                    worklist.push_back(target_loc);
+                }
+            }
+        }
+
+        // copies are built from ranges, as copy construction keeps the bucket count of the source
+        AbstractStore result;
+        result.reserve(reachable.size());
+        for (auto it : reachable)
+        {
+            result.emplace(it->first, PointToMap{it->second.begin(), it->second.end()});
+        }
+
+        return result;
+    }
+
     bool EqualDataDepEdgeCollection(ConstraintSolver& solver,
                                     const ConstrainedDataDependencyGraph::EdgeCollection& col_old,
                                     const ConstrainedDataDependencyGraph::EdgeCollection& col_new)
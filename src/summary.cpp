@@ -1,10 +1,39 @@
 #include "summary.h"
+#include "analysis.h"
+#include "cache.h"
+#include "memory.h"
 
 using namespace std;
 using namespace llvm;
 
 namespace mh
 {
+    AbstractStore CompactSummaryStore(const FunctionSummary& summary, const AbstractStore& store)
+    {
+        vector<AbstractLocation> roots;
+        for (int i = 0; i < summary.deref_chains.NumInputs(); ++i)
+        {
+            roots.push_back(AbstractLocation::FromRegister(summary.inputs[i]));
+            for (int k = 0; k < summary.deref_chains.ChainLength(i); ++k)
+            {
+                roots.push_back(summary.deref_chains.ChainLocation(i, k));
+            }
+        }
+
+        if (summary.return_inst != nullptr)
+        {
+            if (const Value* ret_val = summary.return_inst->getReturnValue(); ret_val != nullptr)
+            {
+                roots.push_back(AbstractLocation::FromRegister(ret_val));
+            }
+        }
+
+        return ExtractReachableStore(store, roots);
+    }
+
+    SummaryEnvironment::SummaryEnvironment()  = default;
+    SummaryEnvironment::~SummaryEnvironment() = default;
+
     FunctionSummary& SummaryEnvironment::LookupSummary(const llvm::Function* func)
     {
         if (auto it = analysis_memory.find(func); it != analysis_memory.end())
@@ -22,7 +51,72 @@ namespace mh
 
     const FunctionSummary& SummaryEnvironment::LookupSummary(const llvm::Function* func) const
     {
-        return *analysis_memory.at(func);
+        const FunctionSummary& summary = *analysis_memory.at(func);
+        if (summary.smt_context == nullptr ||
+            summary.smt_context == &SmtProvider::Current().Context())
+        {
+            return summary;
+        }
+
+        return LookupTranslatedSummary(summary);
+    }
+
+    const FunctionAnalysisInfo& SummaryEnvironment::LookupFunctionInfo(const Function* func) const
+    {
+        {
+            lock_guard<mutex> lock{function_info_mutex};
+            if (auto it = function_infos.find(func); it != function_infos.end())
+            {
+                return *it->second;
+            }
+        }
+
+        // computed outside the lock, a concurrent computation of the same function is dropped
+        auto info = make_unique<FunctionAnalysisInfo>(*analysis_memory.at(func));
+
+        lock_guard<mutex> lock{function_info_mutex};
+        return *function_infos.try_emplace(func, move(info)).first->second;
+    }
+
+    const FunctionSummary&
+    SummaryEnvironment::LookupTranslatedSummary(const FunctionSummary& summary) const
+    {
+        // NOTE the provider is created first, so that it outlives the cache of the thread
+        z3::context& ctx = SmtProvider::Current().Context();
+
+        static thread_local unordered_map<const FunctionSummary*, unique_ptr<FunctionSummary>>
+            translated_summaries;
+
+        // drop copies of summaries evicted since the last lookup of the thread
+        static thread_local pair<const SummaryEnvironment*, size_t> num_purged = {nullptr, 0};
+        if (num_purged.first != this)
+        {
+            num_purged = {this, 0};
+        }
+
+        if (num_purged.second < num_evicted)
+        {
+            lock_guard<mutex> lock{eviction_mutex};
+            for (size_t i = num_purged.second; i < evicted_summaries.size(); ++i)
+            {
+                translated_summaries.erase(evicted_summaries[i]);
+            }
+
+            num_purged.second = evicted_summaries.size();
+        }
+
+        unique_ptr<FunctionSummary>& translated = translated_summaries[&summary];
+        if (translated == nullptr || translated->version != summary.version)
+        {
+            // constraints in the exchange context are touched during the copy
+            lock_guard<mutex> lock{exchange_mutex};
+
+            translated              = make_unique<FunctionSummary>(summary);
+            translated->store       = TranslateStore(summary.store, ctx);
+            translated->smt_context = &ctx;
+        }
+
+        return *translated;
     }
 
     int SummaryEnvironment::ComputeCallPoint(const llvm::Instruction* inst,
@@ -30,6 +124,8 @@ namespace mh
     {
         assert(inst != nullptr && prev_call_point >= 0);
 
+        lock_guard<mutex> lock{call_point_mutex};
+
         if (auto it = call_point_lookup.find({inst, prev_call_point});
             it != call_point_lookup.end())
         {
@@ -60,9 +156,146 @@ namespace mh
         call_point_cache.push_back(CallPointData{depth_to_collapse, inst, prev_call_point});
         call_point_lookup[{inst, prev_call_point}] = result;
 
+        if (MemoryAccounting::Enabled())
+        {
+            MemoryUsage& usage = MemoryAccounting::Current();
+            usage.Reallocate(MemoryCategory::CallPoint, usage.Live(MemoryCategory::CallPoint),
+                             call_point_cache.capacity() * sizeof(CallPointData) +
+                                 EstimateHashMapMemory(call_point_lookup));
+        }
+
         return result;
     }
 
+    CallPointData SummaryEnvironment::LookupCallPoint(int call_point) const
+    {
+        assert(call_point > 0);
+
+        lock_guard<mutex> lock{call_point_mutex};
+        return call_point_cache.at(call_point - 1);
+    }
+
+    void SummaryEnvironment::CollapseCallPoint(int call_point) const
+    {
+        assert(call_point > 0);
+
+        lock_guard<mutex> lock{call_point_mutex};
+        call_point_cache.at(call_point - 1).depth_to_collapse = 0;
+    }
+
+    void SummaryEnvironment::EnableSummaryCache(std::string directory)
+    {
+        summary_cache = make_unique<SummaryCache>(move(directory));
+    }
+
+    void SummaryEnvironment::UpdateSummaryStore(FunctionSummary& summary, AbstractStore store)
+    {
+        if (MemoryAccounting::Enabled())
+        {
+            MemoryAccounting::Current().Reallocate(MemoryCategory::Summary,
+                                                   EstimateMemoryUsage(summary.store),
+                                                   EstimateMemoryUsage(store));
+        }
+
+        summary.store = move(store);
+        summary.version += 1;
+    }
+
+    void SummaryEnvironment::PublishSummary(FunctionSummary& summary)
+    {
+        lock_guard<mutex> lock{exchange_mutex};
+
+        z3::context& ctx = ExchangeContext();
+        if (summary.smt_context != &ctx)
+        {
+            summary.store       = TranslateStore(summary.store, ctx);
+            summary.smt_context = &ctx;
+        }
+    }
+
+    AbstractStore SummaryEnvironment::ExportStore(const AbstractStore& store)
+    {
+        lock_guard<mutex> lock{exchange_mutex};
+
+        return TranslateStore(store, ExchangeContext());
+    }
+
+    void SummaryEnvironment::PublishSummaryStore(FunctionSummary& summary,
+                                                 AbstractStore exported_store)
+    {
+        // constraints of the old store are released
+        lock_guard<mutex> lock{exchange_mutex};
+
+        UpdateSummaryStore(summary, move(exported_store));
+        summary.smt_context = &ExchangeContext();
+    }
+
+    void SummaryEnvironment::NotifyConverged(FunctionSummary& summary)
+    {
+        if (!AnalysisOptions::Current().evict_summaries)
+        {
+            return;
+        }
+
+        lock_guard<mutex> lock{eviction_mutex};
+        for (const Function* callee : summary.called_functions)
+        {
+            // TODO: workaround, why nullptr?
+            if (callee == nullptr || callee->isDeclaration())
+            {
+                continue;
+            }
+
+            FunctionSummary& callee_summary = *analysis_memory.at(callee);
+            callee_summary.num_pending_callers -= 1;
+
+            // a callee in the same recursive component may converge later, and is evicted then
+            if (callee_summary.num_pending_callers == 0 && callee_summary.converged &&
+                !callee_summary.evicted)
+            {
+                EvictSummary(callee_summary);
+            }
+        }
+
+        if (summary.num_pending_callers == 0 && !summary.evicted)
+        {
+            EvictSummary(summary);
+        }
+    }
+
+    void SummaryEnvironment::EvictSummary(FunctionSummary& summary)
+    {
+        {
+            // constraints of a published store are in the exchange context
+            lock_guard<mutex> lock{exchange_mutex};
+
+            if (MemoryAccounting::Enabled())
+            {
+                MemoryAccounting::Current().Release(MemoryCategory::Summary,
+                                                    EstimateMemoryUsage(summary.store));
+            }
+
+            summary.store        = AbstractStore{};
+            summary.summary_locs = unordered_set<AbstractLocation>{};
+        }
+
+        // NOTE the version is kept, so that SummaryCache still finds the fingerprint computed
+        // for the store
+        summary.evicted = true;
+        evicted_summaries.push_back(&summary);
+        num_evicted = evicted_summaries.size();
+    }
+
+    z3::context& SummaryEnvironment::ExchangeContext()
+    {
+        if (exchange_context == nullptr)
+        {
+            exchange_context = make_unique<z3::context>();
+        }
+
+        return *exchange_context;
+    }
+
     void SummaryEnvironment::InitializeSummary(FunctionSummary& summary, const llvm::Function* func)
     {
         summary.func = func;
@@ -74,6 +307,19 @@ namespace mh
             return;
         }
 
+        // count functions calling this function, see NotifyConverged
+        unordered_set<const Function*> callers;
+        for (const User* user : func->users())
+        {
+            const CallInst* call_inst = dyn_cast<CallInst>(user);
+            if (call_inst != nullptr && call_inst->getCalledFunction() == func)
+            {
+                callers.insert(call_inst->getFunction());
+            }
+        }
+
+        summary.num_pending_callers = callers.size();
+
         // collect parameters
         for (const Argument& arg : func->args())
         {
@@ -134,6 +380,12 @@ namespace mh
             }
         }
 
+        // precompute dereference chains of inputs
+        for (const Value* input : summary.inputs)
+        {
+            summary.deref_chains.AppendChain(input);
+        }
+
         // collect return instruction
         // NOTE we assume the last instruction of the function is the only exit point
         // TODO: is this assumption always hold?
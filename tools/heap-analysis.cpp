@@ -0,0 +1,528 @@
+#include "analysis.h"
+#include "cache.h"
+#include "driver.h"
+#include "export.h"
+#include "memory.h"
+#include "options.h"
+#include "query.h"
+
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/Regex.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <sys/resource.h>
+#include <unordered_set>
+#include <vector>
+
+using namespace mh;
+using namespace std;
+using namespace llvm;
+
+extern std::atomic<int> GLOBAL_NUM_RAW_STORE;
+extern std::atomic<int> GLOBAL_NUM_RAW_CALL;
+extern std::atomic<int> GLOBAL_NUM_RAW_ARG;
+
+namespace
+{
+    enum class OutputFormat
+    {
+        Text,
+        Json,
+    };
+
+    cl::OptionCategory tool_category{"Heap Analysis Driver Options"};
+
+    cl::list<string> input_files{cl::Positional, cl::desc("<input bitcode or IR files>"),
+                                 cl::OneOrMore, cl::cat(tool_category)};
+
+    cl::opt<string> output_file{"o", cl::desc("Report file (default = stdout)"),
+                                cl::value_desc("filename"), cl::init("-"), cl::cat(tool_category)};
+
+    cl::opt<OutputFormat> output_format{
+        "format", cl::desc("Report format"),
+        cl::values(clEnumValN(OutputFormat::Text, "text", "human readable lines (default)"),
+                   clEnumValN(OutputFormat::Json, "json", "one JSON document for all inputs")),
+        cl::init(OutputFormat::Text), cl::cat(tool_category)};
+
+    cl::opt<int> num_jobs{"j",
+                          cl::desc("Number of analysis threads, same as -heap-analysis-threads"),
+                          cl::value_desc("threads"), cl::cat(tool_category)};
+
+    cl::opt<double> time_budget{
+        "time-budget",
+        cl::desc("Seconds per module, functions not started by then are skipped (0 = unlimited)"),
+        cl::init(0), cl::cat(tool_category)};
+
+    cl::opt<unsigned> memory_budget{
+        "memory-budget",
+        cl::desc("Megabytes of heap in use, beyond which functions not started are skipped "
+                 "(0 = unlimited)"),
+        cl::init(0), cl::cat(tool_category)};
+
+    cl::list<string> function_filters{
+        "function",
+        cl::desc("Analyze functions matching any of the regexes, and the functions they call"),
+        cl::value_desc("regex"), cl::CommaSeparated, cl::cat(tool_category)};
+
+    cl::opt<string> query_function{
+        "query",
+        cl::desc("Answer point-to and RAW queries of loads in the function on demand, instead of "
+                 "analyzing whole modules"),
+        cl::value_desc("function"), cl::cat(tool_category)};
+
+    // Time and memory limits of analyzing a module
+    // once exceeded, the budget stays exhausted so that all remaining functions are skipped
+    class AnalysisBudget
+    {
+    private:
+        chrono::steady_clock::time_point t_start_ = chrono::steady_clock::now();
+        atomic<bool> exhausted_                   = false;
+
+    public:
+        bool Exhausted()
+        {
+            if (exhausted_)
+            {
+                return true;
+            }
+
+            bool out_of_time =
+                time_budget > 0 &&
+                chrono::duration<double>(chrono::steady_clock::now() - t_start_).count() >
+                    time_budget;
+            bool out_of_memory =
+                memory_budget > 0 && sys::Process::GetMallocUsage() > (size_t{memory_budget} << 20);
+
+            if (out_of_time || out_of_memory)
+            {
+                exhausted_ = true;
+            }
+
+            return exhausted_;
+        }
+
+        double ElapsedMilliseconds() const
+        {
+            return chrono::duration<double, milli>(chrono::steady_clock::now() - t_start_).count();
+        }
+    };
+
+    struct FunctionReport
+    {
+        string name;
+        bool converged    = false;
+        bool evicted      = false;
+        int num_locations = 0;
+        int num_edges     = 0;
+        AnalysisStatistics stats;
+    };
+
+    struct ModuleReport
+    {
+        string input;
+        bool complete              = true;
+        double time_ms             = 0;
+        int64_t num_solver_queries = 0;
+
+        // peak resident set size of the process after analyzing the module
+        long peak_rss_kb = 0;
+
+        DataDependencyCounts raw;
+        vector<FunctionReport> functions;
+    };
+
+    // functions matching the filters and the functions they call
+    // empty if there is no filter, i.e. all functions are in scope
+    unordered_set<const Function*> CollectFunctionsInScope(const Module& module,
+                                                           CallGraph& call_graph)
+    {
+        unordered_set<const Function*> result;
+        if (function_filters.empty())
+        {
+            return result;
+        }
+
+        vector<Regex> regexes;
+        for (const string& filter : function_filters)
+        {
+            regexes.emplace_back(filter);
+        }
+
+        vector<const CallGraphNode*> worklist;
+        for (const Function& func : module)
+        {
+            for (const Regex& regex : regexes)
+            {
+                if (regex.match(func.getName()))
+                {
+                    worklist.push_back(call_graph[&func]);
+                    break;
+                }
+            }
+        }
+
+        while (!worklist.empty())
+        {
+            const CallGraphNode* node = worklist.back();
+            worklist.pop_back();
+
+            const Function* func = node->getFunction();
+            if (func == nullptr || !result.insert(func).second)
+            {
+                continue;
+            }
+
+            for (const auto& [call, callee_node] : *node)
+            {
+                worklist.push_back(callee_node);
+            }
+        }
+
+        return result;
+    }
+
+    ModuleReport AnalyzeModule(Module& module, const string& input, ResultExporter* exporter)
+    {
+        ModuleReport report;
+        report.input = input;
+
+        DataDependencyCounts raw_before{GLOBAL_NUM_RAW_STORE.load(), GLOBAL_NUM_RAW_CALL.load(),
+                                        GLOBAL_NUM_RAW_ARG.load()};
+
+        AnalysisBudget budget;
+        SummaryEnvironment env;
+        if (!AnalysisOptions::Current().summary_cache_dir.empty())
+        {
+            env.EnableSummaryCache(AnalysisOptions::Current().summary_cache_dir);
+        }
+
+        if (exporter != nullptr)
+        {
+            exporter->BeginModule(module);
+            env.SetExporter(exporter);
+        }
+
+        unique_ptr<ParallelAnalysisDriver> driver;
+        if (AnalysisOptions::Current().num_threads != 1)
+        {
+            driver =
+                make_unique<ParallelAnalysisDriver>(&env, AnalysisOptions::Current().num_threads);
+        }
+
+        CallGraph call_graph{module};
+        unordered_set<const Function*> scope = CollectFunctionsInScope(module, call_graph);
+        auto in_scope = [&](const Function* func) {
+            return func != nullptr && !func->isDeclaration() &&
+                   (function_filters.empty() || scope.count(func) > 0);
+        };
+
+        // bottom-up, as visited by CallGraphSCCPass
+        vector<const Function*> analyzed_funcs;
+        for (auto it = scc_begin(&call_graph); !it.isAtEnd(); ++it)
+        {
+            const vector<CallGraphNode*>& scc = *it;
+            bool scc_in_scope                 = false;
+            for (const CallGraphNode* node : scc)
+            {
+                if (in_scope(node->getFunction()))
+                {
+                    analyzed_funcs.push_back(node->getFunction());
+                    scc_in_scope = true;
+                }
+            }
+
+            if (!scc_in_scope)
+            {
+                continue;
+            }
+
+            if (driver == nullptr && budget.Exhausted())
+            {
+                report.complete = false;
+                break;
+            }
+
+            AnalyzeCallGraphSCC(env, driver.get(), scc);
+        }
+
+        if (driver != nullptr)
+        {
+            driver->Run([&] { return budget.Exhausted(); });
+            report.complete = !budget.Exhausted();
+        }
+
+        report.time_ms           = budget.ElapsedMilliseconds();
+        report.raw.num_raw_store = GLOBAL_NUM_RAW_STORE - raw_before.num_raw_store;
+        report.raw.num_raw_call  = GLOBAL_NUM_RAW_CALL - raw_before.num_raw_call;
+        report.raw.num_raw_arg   = GLOBAL_NUM_RAW_ARG - raw_before.num_raw_arg;
+
+        for (const Function* func : analyzed_funcs)
+        {
+            const FunctionSummary& summary = env.LookupSummary(func);
+
+            FunctionReport& func_report = report.functions.emplace_back();
+            func_report.name            = func->getName().str();
+            func_report.converged       = summary.converged;
+            func_report.evicted         = summary.evicted;
+            func_report.num_locations   = summary.store.size();
+            func_report.stats           = summary.stats;
+            for (const auto& [loc, pt_map] : summary.store)
+            {
+                func_report.num_edges += pt_map.size();
+            }
+
+            report.complete = report.complete && summary.converged;
+            report.num_solver_queries += summary.stats.num_solver_queries;
+        }
+
+        rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0)
+        {
+            report.peak_rss_kb = usage.ru_maxrss;
+        }
+
+        if (MemoryAccounting::Enabled())
+        {
+            MemoryAccounting::SampleSmtContext();
+            MemoryAccounting::Current().Report(fmt::format("module {}", input));
+        }
+
+        if (const SummaryCache* cache = env.Cache())
+        {
+            errs() << fmt::format("Summary Cache: {} hits, {} misses, {} unchanged\n",
+                                  cache->NumHits(), cache->NumMisses(), cache->NumUnchanged());
+        }
+
+        return report;
+    }
+
+    // query loads of a function with QueryEngine, returns false if the function is not defined
+    bool QueryFunction(Module& module, const string& input, raw_ostream& os)
+    {
+        const Function* func = module.getFunction(query_function);
+        if (func == nullptr || func->isDeclaration())
+        {
+            errs() << fmt::format("error: no function {} defined in {}\n", query_function, input);
+            return false;
+        }
+
+        SummaryEnvironment env;
+        if (!AnalysisOptions::Current().summary_cache_dir.empty())
+        {
+            env.EnableSummaryCache(AnalysisOptions::Current().summary_cache_dir);
+        }
+
+        QueryEngine engine{env};
+        auto t_start = chrono::steady_clock::now();
+
+        int num_loads = 0;
+        for (const Instruction& inst : instructions(func))
+        {
+            const LoadInst* load_inst = dyn_cast<LoadInst>(&inst);
+            if (load_inst == nullptr)
+            {
+                continue;
+            }
+
+            num_loads += 1;
+            os << fmt::format("{}\n", static_cast<const Value&>(inst));
+            for (auto [loc, c] : engine.PointsTo(load_inst->getPointerOperand()))
+            {
+                c.Simplify();
+                os << fmt::format("  points to {} ? {}\n", loc, c);
+            }
+            for (auto [src, c] : engine.RawDeps(load_inst))
+            {
+                c.Simplify();
+                os << fmt::format("  reads {} ? {}\n", *src, c);
+            }
+        }
+
+        double time_ms =
+            chrono::duration<double, milli>(chrono::steady_clock::now() - t_start).count();
+        os << fmt::format("function {} in {}: {} loads queried in {:.1f} ms\n", query_function,
+                          input, num_loads, time_ms);
+        return true;
+    }
+
+    void PrintTextReport(raw_ostream& os, const vector<ModuleReport>& reports)
+    {
+        for (const ModuleReport& report : reports)
+        {
+            os << fmt::format("module {}: {}, {:.1f} ms, {} solver queries, peak RSS {} KB\n",
+                              report.input, report.complete ? "complete" : "incomplete",
+                              report.time_ms, report.num_solver_queries, report.peak_rss_kb);
+            os << fmt::format("  RAW (load-store) = {}, (load-call) = {}, (load-arg) = {}\n",
+                              report.raw.num_raw_store, report.raw.num_raw_call,
+                              report.raw.num_raw_arg);
+
+            for (const FunctionReport& func : report.functions)
+            {
+                // locations of an evicted summary are released, see -heap-analysis-evict-summaries
+                const char* status = func.converged ? "converged" : "skipped";
+                if (func.evicted)
+                {
+                    status = "evicted";
+                }
+                else if (func.converged && func.stats.num_degraded_runs > 0)
+                {
+                    status = "degraded";
+                }
+
+                os << fmt::format(
+                    "  function {}: {}, {} locations, {} edges, {} runs, {:.1f} ms, {} queries\n",
+                    func.name, status, func.num_locations, func.num_edges, func.stats.num_runs,
+                    func.stats.time_ms, func.stats.num_solver_queries);
+            }
+        }
+    }
+
+    void PrintJsonReport(raw_ostream& os, const vector<ModuleReport>& reports)
+    {
+        json::OStream json{os, 2};
+        json.array([&] {
+            for (const ModuleReport& report : reports)
+            {
+                json.object([&] {
+                    json.attribute("input", report.input);
+                    json.attribute("complete", report.complete);
+                    json.attribute("time_ms", report.time_ms);
+                    json.attribute("solver_queries", report.num_solver_queries);
+                    json.attribute("peak_rss_kb", static_cast<int64_t>(report.peak_rss_kb));
+                    json.attributeObject("raw", [&] {
+                        json.attribute("load_store", report.raw.num_raw_store);
+                        json.attribute("load_call", report.raw.num_raw_call);
+                        json.attribute("load_arg", report.raw.num_raw_arg);
+                    });
+                    json.attributeArray("functions", [&] {
+                        for (const FunctionReport& func : report.functions)
+                        {
+                            json.object([&] {
+                                json.attribute("name", func.name);
+                                json.attribute("converged", func.converged);
+                                json.attribute("evicted", func.evicted);
+                                json.attribute("locations", func.num_locations);
+                                json.attribute("edges", func.num_edges);
+                                json.attribute("runs", func.stats.num_runs);
+                                json.attribute("time_ms", func.stats.time_ms);
+                                json.attribute("solver_queries", func.stats.num_solver_queries);
+                                json.attribute("degraded_runs", func.stats.num_degraded_runs);
+                            });
+                        }
+                    });
+                });
+            }
+        });
+        os << "\n";
+    }
+} // namespace
+
+// Standalone driver of the analysis, loads modules directly instead of running in opt
+// Options of the analysis, i.e. -heap-analysis-*, are accepted as well
+int main(int argc, char** argv)
+{
+    InitLLVM init{argc, argv};
+    cl::ParseCommandLineOptions(argc, argv, "heap analysis driver\n");
+
+    if (num_jobs.getNumOccurrences() > 0)
+    {
+        AnalysisOptions::Current().num_threads = num_jobs;
+    }
+
+    for (const string& filter : function_filters)
+    {
+        string error;
+        if (!Regex{filter}.isValid(error))
+        {
+            errs() << fmt::format("error: invalid function filter '{}': {}\n", filter, error);
+            return 1;
+        }
+    }
+
+    error_code ec;
+    ToolOutputFile output{output_file, ec, sys::fs::OF_Text};
+    if (ec)
+    {
+        errs() << fmt::format("error: can't open {}: {}\n", output_file, ec.message());
+        return 1;
+    }
+
+    // one export of all inputs, records of each module follow its module record
+    unique_ptr<ResultExporter> exporter;
+    if (const string& path = AnalysisOptions::Current().export_file; !path.empty())
+    {
+        string error;
+        exporter = ResultExporter::Create(path, AnalysisOptions::Current().export_format, error);
+        if (exporter == nullptr)
+        {
+            errs() << fmt::format("error: can't open {}: {}\n", path, error);
+            return 1;
+        }
+    }
+
+    vector<ModuleReport> reports;
+    for (const string& input : input_files)
+    {
+        LLVMContext llvm_ctx;
+        SMDiagnostic diag;
+        unique_ptr<Module> module = parseIRFile(input, diag, llvm_ctx);
+        if (module == nullptr)
+        {
+            diag.print(argv[0], errs());
+            return 1;
+        }
+
+        if (!query_function.empty())
+        {
+            if (!QueryFunction(*module, input, output.os()))
+            {
+                return 1;
+            }
+
+            continue;
+        }
+
+        reports.push_back(AnalyzeModule(*module, input, exporter.get()));
+    }
+
+    if (!query_function.empty())
+    {
+        output.keep();
+        return 0;
+    }
+
+    if (output_format == OutputFormat::Json)
+    {
+        PrintJsonReport(output.os(), reports);
+    }
+    else
+    {
+        PrintTextReport(output.os(), reports);
+    }
+
+    output.keep();
+
+    // 2 for partial results, so that batch scripts can tell budget exhaustion from errors
+    for (const ModuleReport& report : reports)
+    {
+        if (!report.complete)
+        {
+            return 2;
+        }
+    }
+
+    return 0;
+}